@@ -67,12 +67,12 @@ double CAddrInfo::GetChance(int64_t nNow) const
 
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    auto it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    auto it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return nullptr;
@@ -81,13 +81,14 @@ CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
     int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
+    CAddrInfo& info = mapInfo[nId];
+    info = CAddrInfo(addr, addrSource);
     mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    info.nRandomPos = vRandom.size();
     vRandom.push_back(nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &info;
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -132,7 +133,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
@@ -145,7 +146,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -166,7 +167,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -177,12 +178,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -302,7 +303,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -343,20 +344,19 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         return CAddrInfo();
 
     // Use a 50% chance for choosing between tried and new table entries.
+    // Positions are drawn from the index of occupied positions, so each draw
+    // takes constant time regardless of how full the tables are.
     if (!newOnly &&
        (nTried > 0 && (nNew == 0 || RandomInt(2) == 0))) { 
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = RandomInt(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
+            int nKBucket, nKBucketPos;
+            triedIndex.Get(RandomInt(triedIndex.size()), nKBucket, nKBucketPos);
             int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            auto it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            CAddrInfo& info = it->second;
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -365,15 +365,12 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = RandomInt(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = RandomInt(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
+            int nUBucket, nUBucketPos;
+            newIndex.Get(RandomInt(newIndex.size()), nUBucket, nUBucketPos);
             int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            auto it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            CAddrInfo& info = it->second;
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -390,7 +387,12 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
+    if (!triedIndex.IsConsistent() || !newIndex.IsConsistent())
+        return -21;
+    if (triedIndex.size() != (size_t)nTried)
+        return -20;
+
+    for (auto it = mapInfo.begin(); it != mapInfo.end(); it++) {
         int n = (*it).first;
         CAddrInfo& info = (*it).second;
         if (info.fInTried) {
@@ -423,6 +425,8 @@ int CAddrMan::Check_()
 
     for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+             if (triedIndex.Contains(n, i) != (vvTried[n][i] != -1))
+                 return -22;
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
@@ -435,9 +439,13 @@ int CAddrMan::Check_()
         }
     }
 
+    size_t nNewOccupied = 0;
     for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
         for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+            if (newIndex.Contains(n, i) != (vvNew[n][i] != -1))
+                return -23;
             if (vvNew[n][i] != -1) {
+                nNewOccupied++;
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
                 if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
@@ -448,6 +456,8 @@ int CAddrMan::Check_()
         }
     }
 
+    if (newIndex.size() != nNewOccupied)
+        return -24;
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -472,9 +482,10 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
         int nRndPos = RandomInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        auto it = mapInfo.find(vRandom[n]);
+        assert(it != mapInfo.end());
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = it->second;
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -16,6 +16,7 @@
 #include <map>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -176,6 +177,95 @@ public:
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
 
+/** Salted hasher for the network address lookup table of CAddrMan. */
+class CAddrManAddrHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    CAddrManAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CNetAddr& addr) const {
+        return addr.GetSaltedHash(k0, k1);
+    }
+};
+
+/**
+ * Dense list of the occupied positions in a table of buckets, so that a
+ * uniformly random occupied position can be picked in constant time, no
+ * matter how sparse the table is.
+ */
+template<int BUCKET_COUNT>
+class CAddrManBucketIndex
+{
+private:
+    //! occupied positions, as bucket * ADDRMAN_BUCKET_SIZE + position
+    std::vector<int> vPos;
+
+    //! for every position, its index in vPos, or -1 if unoccupied
+    int vIndex[BUCKET_COUNT * ADDRMAN_BUCKET_SIZE];
+
+public:
+    CAddrManBucketIndex()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        vPos.clear();
+        for (int n = 0; n < BUCKET_COUNT * ADDRMAN_BUCKET_SIZE; n++) {
+            vIndex[n] = -1;
+        }
+    }
+
+    //! Record whether a position is occupied.
+    void Update(int nBucket, int nBucketPos, bool fOccupied)
+    {
+        int nPos = nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos;
+        if (fOccupied && vIndex[nPos] == -1) {
+            vIndex[nPos] = vPos.size();
+            vPos.push_back(nPos);
+        } else if (!fOccupied && vIndex[nPos] != -1) {
+            // Move the last entry into the vacated slot.
+            int nLast = vPos.back();
+            vPos[vIndex[nPos]] = nLast;
+            vIndex[nLast] = vIndex[nPos];
+            vPos.pop_back();
+            vIndex[nPos] = -1;
+        }
+    }
+
+    size_t size() const
+    {
+        return vPos.size();
+    }
+
+    //! Get the n'th occupied position.
+    void Get(size_t n, int& nBucket, int& nBucketPos) const
+    {
+        nBucket = vPos[n] / ADDRMAN_BUCKET_SIZE;
+        nBucketPos = vPos[n] % ADDRMAN_BUCKET_SIZE;
+    }
+
+    //! Whether a position is recorded as occupied.
+    bool Contains(int nBucket, int nBucketPos) const
+    {
+        return vIndex[nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos] != -1;
+    }
+
+    //! Whether every entry of vPos is in range and points back at itself through vIndex.
+    bool IsConsistent() const
+    {
+        for (size_t n = 0; n < vPos.size(); n++) {
+            if (vPos[n] < 0 || vPos[n] >= BUCKET_COUNT * ADDRMAN_BUCKET_SIZE || vIndex[vPos[n]] != (int)n)
+                return false;
+        }
+        return true;
+    }
+};
+
 /** 
  * Stochastical (IP) address manager 
  */
@@ -189,10 +279,10 @@ private:
     int nIdCount;
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    std::unordered_map<int, CAddrInfo> mapInfo;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    std::unordered_map<CNetAddr, int, CAddrManAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -203,12 +293,18 @@ private:
     //! list of "tried" buckets
     int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions in vvTried
+    CAddrManBucketIndex<ADDRMAN_TRIED_BUCKET_COUNT> triedIndex;
+
     //! number of (unique) "new" entries
     int nNew;
 
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
+    //! occupied positions in vvNew
+    CAddrManBucketIndex<ADDRMAN_NEW_BUCKET_COUNT> newIndex;
+
     //! last time Good was called (memory only)
     int64_t nLastGood;
 
@@ -229,6 +325,20 @@ protected:
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    //! Set a position in the "new" table to nId (or -1 to clear it).
+    void SetNew(int nUBucket, int nUBucketPos, int nId)
+    {
+        vvNew[nUBucket][nUBucketPos] = nId;
+        newIndex.Update(nUBucket, nUBucketPos, nId != -1);
+    }
+
+    //! Set a position in the "tried" table to nId (or -1 to clear it).
+    void SetTried(int nKBucket, int nKBucketPos, int nId)
+    {
+        vvTried[nKBucket][nKBucketPos] = nId;
+        triedIndex.Update(nKBucket, nKBucketPos, nId != -1);
+    }
+
     //! Move an entry from the "new" table(s) to the "tried" table
     void MakeTried(CAddrInfo& info, int nId);
 
@@ -311,20 +421,21 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        std::unordered_map<int, int> mapUnkIds;
+        mapUnkIds.reserve(nNew);
         int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            mapUnkIds[(*it).first] = nIds;
-            const CAddrInfo &info = (*it).second;
+        for (const auto& entry : mapInfo) {
+            const CAddrInfo &info = entry.second;
             if (info.nRefCount) {
+                mapUnkIds[entry.first] = nIds;
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
                 s << info;
                 nIds++;
             }
         }
         nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            const CAddrInfo &info = (*it).second;
+        for (const auto& entry : mapInfo) {
+            const CAddrInfo &info = entry.second;
             if (info.fInTried) {
                 assert(nIds != nTried); // this means nTried was wrong, oh ow
                 s << info;
@@ -376,6 +487,9 @@ public:
             throw std::ios_base::failure("Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
 
+        mapInfo.reserve(nNew + nTried);
+        mapAddr.reserve(nNew + nTried);
+
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
             CAddrInfo &info = mapInfo[n];
@@ -389,7 +503,7 @@ public:
                 int nUBucket = info.GetNewBucket(nKey);
                 int nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
                 if (vvNew[nUBucket][nUBucketPos] == -1) {
-                    vvNew[nUBucket][nUBucketPos] = n;
+                    SetNew(nUBucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -409,7 +523,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -429,7 +543,7 @@ public:
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
-                        vvNew[bucket][nUBucketPos] = nIndex;
+                        SetNew(bucket, nUBucketPos, nIndex);
                     }
                 }
             }
@@ -437,9 +551,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -467,6 +581,8 @@ public:
                 vvTried[bucket][entry] = -1;
             }
         }
+        newIndex.Clear();
+        triedIndex.Clear();
 
         nIdCount = 0;
         nTried = 0;
@@ -0,0 +1,129 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "addrman.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+
+#include <vector>
+
+/* A "source" is a source address from which we have received a bunch of other addresses. */
+
+static constexpr size_t NUM_SOURCES = 256;
+static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
+
+static std::vector<CAddress> g_sources;
+static std::vector<std::vector<CAddress>> g_addresses;
+
+static CAddress RandomAddress(FastRandomContext& rand)
+{
+    // Public IPv4 addresses, spread over many /16 groups.
+    uint8_t ip[4];
+    ip[0] = 1 + rand.randrange(9);
+    ip[1] = rand.randbits(8);
+    ip[2] = rand.randbits(8);
+    ip[3] = rand.randbits(8);
+    CNetAddr addr;
+    addr.SetRaw(NET_IPV4, ip);
+    CAddress ret(CService(addr, 8333), NODE_NETWORK);
+    ret.nTime = GetAdjustedTime();
+    return ret;
+}
+
+static void CreateAddresses()
+{
+    if (g_sources.size() > 0) { // already created
+        return;
+    }
+
+    FastRandomContext rand(true);
+    g_sources.resize(NUM_SOURCES);
+    g_addresses.resize(NUM_SOURCES);
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        g_sources[source_i] = RandomAddress(rand);
+        g_addresses[source_i].resize(NUM_ADDRESSES_PER_SOURCE);
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
+            g_addresses[source_i][addr_i] = RandomAddress(rand);
+        }
+    }
+}
+
+static void AddAddressesToAddrMan(CAddrMan& addrman)
+{
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        addrman.Add(g_addresses[source_i], g_sources[source_i]);
+    }
+}
+
+/** Fill the new table to (close to) capacity and move a sample of the addresses to the tried table. */
+static void FillAddrMan(CAddrMan& addrman)
+{
+    AddAddressesToAddrMan(addrman);
+    for (size_t source_i = 0; source_i < NUM_SOURCES; source_i += 16) {
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; addr_i += 16) {
+            addrman.Good(g_addresses[source_i][addr_i]);
+        }
+    }
+}
+
+static void AddrManAdd(benchmark::State& state)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+    while (state.KeepRunning()) {
+        AddAddressesToAddrMan(addrman);
+        addrman.Clear();
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        const CAddress& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        std::vector<CAddress> addresses = addrman.GetAddr();
+        assert(addresses.size() > 0);
+    }
+}
+
+static void AddrManSerialize(benchmark::State& state)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+        ssPeers << addrman;
+        CAddrMan addrmanLoaded;
+        ssPeers >> addrmanLoaded;
+        assert(addrmanLoaded.size() == addrman.size());
+    }
+}
+
+BENCHMARK(AddrManAdd);
+BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManGetAddr);
+BENCHMARK(AddrManSerialize);
@@ -4,10 +4,13 @@
 
 #include "bench.h"
 
+#include "blockencodings.h"
 #include "chainparams.h"
+#include "consensus/merkle.h"
 #include "validation.h"
 #include "streams.h"
 #include "consensus/validation.h"
+#include "txmempool.h"
 
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
@@ -52,5 +55,65 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// Everything validation then asks of each transaction besides its txid: the
+// wtxid for the witness commitment and the sizes for the block weight.
+static void DeserializeBlockWeightTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        assert(stream.Rewind(sizeof(block_bench::block413567)));
+
+        bool mutated;
+        BlockWitnessMerkleRoot(block, &mutated);
+        assert(GetBlockWeight(block) > 0);
+    }
+}
+
+// Rebuilding a block from a compact block announcement sits on the same
+// critical path: every mempool transaction is hashed with the block's short ID
+// keys and looked up among its short IDs. The block's transactions are added
+// after a large number of unrelated ones, so the scan cannot exit early.
+static void ReconstructCompactBlockTest(benchmark::State& state)
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    CTxMemPool pool;
+    LockPoints lp;
+    CMutableTransaction filler;
+    filler.vin.resize(1);
+    filler.vout.resize(1);
+    filler.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    filler.vout[0].nValue = COIN;
+    for (uint32_t i = 0; i < 50000; i++) {
+        filler.vin[0].prevout.n = i;
+        pool.addUnchecked(filler.GetHash(), CTxMemPoolEntry(MakeTransactionRef(filler), 1000, 0, 1, false, 4, lp));
+    }
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        pool.addUnchecked(block.vtx[i]->GetHash(), CTxMemPoolEntry(block.vtx[i], 1000, 0, 1, false, 4, lp));
+    }
+
+    CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partialBlock(&pool);
+        assert(partialBlock.InitData(cmpctblock, extra_txn) == READ_STATUS_OK);
+        assert(partialBlock.IsTxAvailable(block.vtx.size() - 1));
+    }
+}
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeBlockWeightTest);
+BENCHMARK(ReconstructCompactBlockTest);
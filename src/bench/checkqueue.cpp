@@ -7,6 +7,7 @@
 #include "validation.h"
 #include "checkqueue.h"
 #include "prevector.h"
+#include "crypto/sha256.h"
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include "random.h"
@@ -99,5 +100,51 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark feeds the CheckQueue the way ConnectBlock does: many small
+// batches (one per transaction) of checks that each do a bit of hashing,
+// with a fixed number of worker threads, to show how well the workers keep
+// up while the master is still adding.
+static const size_t BLOCK_TXS = 2000;
+static const size_t TX_INPUTS = 2;
+static const int HASH_ROUNDS = 32;
+static void CCheckQueueSpeedThreads(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        unsigned char data[CSHA256::OUTPUT_SIZE] = {};
+        bool operator()()
+        {
+            for (int i = 0; i < HASH_ROUNDS; i++)
+                CSHA256().Write(data, sizeof(data)).Finalize(data);
+            return true;
+        }
+        void swap(HashJob& x){std::swap(data, x.data);};
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t tx = 0; tx < BLOCK_TXS; ++tx) {
+            std::vector<HashJob> vChecks(TX_INPUTS);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void CCheckQueueSpeedThreads8(benchmark::State& state) { CCheckQueueSpeedThreads(state, 8); }
+static void CCheckQueueSpeedThreads16(benchmark::State& state) { CCheckQueueSpeedThreads(state, 16); }
+static void CCheckQueueSpeedThreads32(benchmark::State& state) { CCheckQueueSpeedThreads(state, 32); }
+static void CCheckQueueSpeedThreads64(benchmark::State& state) { CCheckQueueSpeedThreads(state, 64); }
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK(CCheckQueueSpeedThreads8);
+BENCHMARK(CCheckQueueSpeedThreads16);
+BENCHMARK(CCheckQueueSpeedThreads32);
+BENCHMARK(CCheckQueueSpeedThreads64);
@@ -56,4 +56,40 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// Large hot wallet: 200k coins of varied value. A target that can be hit
+// exactly exercises the branch and bound search; one that can't falls back
+// to the stochastic solver over the whole pool.
+static void LargeWalletSelection(benchmark::State& state, const CAmount& nTargetValue, const CAmount& nCostOfChange)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 200000; i++)
+        addCoin((1 + (i * 7919) % 10000) * CENT / 100, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(nTargetValue, 1, 6, 0, vCoins, setCoinsRet, nValueRet, nCostOfChange);
+        assert(success);
+        assert(nValueRet >= nTargetValue);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+static void CoinSelectionLargeWalletBnB(benchmark::State& state)
+{
+    LargeWalletSelection(state, 12345 * CENT / 100, CENT / 1000);
+}
+
+static void CoinSelectionLargeWalletApprox(benchmark::State& state)
+{
+    LargeWalletSelection(state, 250 * COIN + 1, 0);
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionLargeWalletBnB);
+BENCHMARK(CoinSelectionLargeWalletApprox);
@@ -6,6 +6,7 @@
 
 #include "bench.h"
 #include "bloom.h"
+#include "consensus/merkle.h"
 #include "hash.h"
 #include "random.h"
 #include "uint256.h"
@@ -52,6 +53,39 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+/* Double-SHA256 of 1024 64-byte blobs, one at a time as the merkle code used to. */
+static void SHA256D64_1024_Serial(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1024; i++) {
+            CHash256().Write(&in[64 * i], 64).Finalize(&in[32 * i]);
+        }
+    }
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
+static void MerkleRoot(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves(9001);
+    for (auto& leaf : leaves) {
+        leaf = rng.rand256();
+    }
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutated);
+        leaves[mutated] = hash;
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -98,6 +132,9 @@ BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024_Serial);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(MerkleRoot);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -0,0 +1,93 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <vector>
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime, nHeight,
+                                        spendsCoinbase, sigOpCost, lp));
+}
+
+// A low fee parent with ten outputs, each spent by a chain of nine
+// transactions whose fees vary, giving a single cluster of 91 transactions
+// that mixes CPFP packages with low feerate tails.
+static std::vector<CMutableTransaction> CreateCluster()
+{
+    std::vector<CMutableTransaction> vtx;
+    CMutableTransaction root;
+    root.vin.resize(1);
+    root.vin[0].scriptSig = CScript() << OP_1;
+    root.vout.resize(10);
+    for (unsigned int i = 0; i < root.vout.size(); i++) {
+        root.vout[i].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        root.vout[i].nValue = COIN;
+    }
+    vtx.push_back(root);
+    for (unsigned int i = 0; i < root.vout.size(); i++) {
+        uint256 prev = root.GetHash();
+        for (unsigned int j = 0; j < 9; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(prev, j == 0 ? i : 0);
+            tx.vin[0].scriptSig = CScript() << OP_2;
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+            tx.vout[0].nValue = COIN;
+            vtx.push_back(tx);
+            prev = tx.GetHash();
+        }
+    }
+    return vtx;
+}
+
+static CAmount ClusterFee(size_t i)
+{
+    return 1000 + (i * 7919) % 20000;
+}
+
+static void MempoolClusterLinearize(benchmark::State& state)
+{
+    std::vector<CMutableTransaction> vtx = CreateCluster();
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        AddTx(vtx[i], ClusterFee(i), pool);
+    }
+    CTxMemPool::txiter root = pool.mapTx.find(vtx[0].GetHash());
+    std::vector<CTxMemPool::TxChunk> vChunks;
+
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setCluster;
+        pool.CalculateCluster(root, setCluster, MAX_CLUSTER_LINEARIZE_COUNT);
+        pool.LinearizeCluster(setCluster, vChunks);
+    }
+}
+
+static void MempoolClusterEviction(benchmark::State& state)
+{
+    std::vector<CMutableTransaction> vtx = CreateCluster();
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < vtx.size(); i++) {
+            AddTx(vtx[i], ClusterFee(i), pool);
+        }
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 2);
+        pool.TrimToSize(0);
+    }
+}
+
+BENCHMARK(MempoolClusterLinearize);
+BENCHMARK(MempoolClusterEviction);
@@ -3,16 +3,24 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "checkqueue.h"
 #include "key.h"
 #if defined(HAVE_CONSENSUS_LIB)
 #include "script/bitcoinconsensus.h"
 #endif
+#include "pos.h"
+#include "random.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "streams.h"
+#include "util.h"
+#include "validation.h"
 
 #include <array>
 
+#include <boost/thread/thread.hpp>
+
 // FIXME: Dedup with BuildCreditingTransaction in test/script_tests.cpp.
 static CMutableTransaction BuildCreditingTransaction(const CScript& scriptPubKey)
 {
@@ -106,3 +114,200 @@ static void VerifyScriptBench(benchmark::State& state)
 }
 
 BENCHMARK(VerifyScriptBench);
+
+static const int BLOCK_SIG_MIN_CORES = 2;
+static const size_t BLOCK_SIG_CHECKS = 16;
+
+// Builds a minimal proof-of-stake block paying the stake to a P2PK output and
+// signed by the same key.
+static CBlock BuildSignedStakeBlock(uint32_t nTime = 0)
+{
+    CKey key;
+    static const std::array<unsigned char, 32> vchKey = {
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+        }
+    };
+    key.Set(vchKey.begin(), vchKey.end(), true);
+
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vin[0].prevout.SetNull();
+    txCoinbase.vout.resize(1);
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.nVersion = 3;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout.hash = uint256S("0x01");
+    txCoinStake.vin[0].prevout.n = 0;
+    txCoinStake.vout.resize(1);
+    txCoinStake.vout[0].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    txCoinStake.vout[0].nValue = 1;
+
+    CBlock block;
+    block.nTime = nTime;
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinbase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    assert(block.IsProofOfStake());
+    key.Sign(block.GetHash(), block.vchBlockSig);
+    return block;
+}
+
+// Proof-of-stake block signatures verified one after another, as ConnectBlock
+// does when no script check threads are running.
+static void VerifyBlockSignatureSerial(benchmark::State& state)
+{
+    const CBlock block = BuildSignedStakeBlock();
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < BLOCK_SIG_CHECKS; i++) {
+            bool success = CheckBlockSignature(block);
+            assert(success);
+        }
+    }
+}
+
+// The same signatures handed to the script check queue, the way ConnectBlock
+// queues the block signature next to the block's input scripts.
+static void VerifyBlockSignatureQueued(benchmark::State& state)
+{
+    const CBlock block = BuildSignedStakeBlock();
+    CCheckQueue<CScriptCheck> queue{128};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(BLOCK_SIG_MIN_CORES, GetNumCores()); ++x) {
+        tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        std::vector<CScriptCheck> vChecks;
+        vChecks.reserve(BLOCK_SIG_CHECKS);
+        for (size_t i = 0; i < BLOCK_SIG_CHECKS; i++) {
+            vChecks.emplace_back(block);
+        }
+        control.Add(vChecks);
+        bool success = control.Wait();
+        assert(success);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static const size_t POS_RANGE_BLOCKS = 100;
+
+// Proof-of-stake work ConnectBlock does for a run of blocks during initial
+// block download: the block signature and the proof hash. Neither is skipped
+// for blocks covered by -assumevalid.
+static void VerifyPoSRange(benchmark::State& state)
+{
+    std::vector<CBlock> vBlocks;
+    for (size_t i = 0; i < POS_RANGE_BLOCKS; i++) {
+        vBlocks.push_back(BuildSignedStakeBlock(1500000000 + 16 * i));
+    }
+    const uint256 nStakeModifier = uint256S("0x2a");
+    while (state.KeepRunning()) {
+        for (const CBlock& block : vBlocks) {
+            bool success = CheckBlockSignature(block);
+            assert(success);
+            GetStakeHashProof(block.PrevoutStake(), block.nTime, block.nTime - STAKE_MIN_AGE, nStakeModifier);
+        }
+    }
+}
+
+static const unsigned int LEGACY_SIGHASH_INPUTS = 1000;
+
+// Hash every input of a 1000-input legacy transaction, as checking all of its
+// signatures does, with and without the precomputed serialization.
+static void SignatureHashLegacy(benchmark::State& state, bool fPrecompute)
+{
+    CMutableTransaction txMut;
+    txMut.vin.resize(LEGACY_SIGHASH_INPUTS);
+    for (unsigned int i = 0; i < txMut.vin.size(); i++) {
+        txMut.vin[i].prevout = COutPoint(GetRandHash(), i);
+        txMut.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+    }
+    txMut.vout.resize(2);
+    const CTransaction tx(txMut);
+    const CScript scriptCode = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1))));
+
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            SignatureHash(scriptCode, tx, i, SIGHASH_ALL | SIGHASH_FORKID, 0, SIGVERSION_BASE, fPrecompute ? &txdata : nullptr);
+        }
+    }
+}
+
+static void SignatureHashLegacySerializer(benchmark::State& state) { SignatureHashLegacy(state, false); }
+static void SignatureHashLegacyPrecomputed(benchmark::State& state) { SignatureHashLegacy(state, true); }
+
+// Accepts every signature, so that the standard template benchmarks measure
+// the script evaluation around the signature checks rather than ECDSA.
+class AcceptingSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override
+    {
+        return true;
+    }
+};
+
+enum class StandardTemplate { P2PKH, P2PK, P2SH_MULTISIG };
+
+// Spend of a P2PKH, P2PK or P2SH 2-of-3 output, verified through the
+// standard template path or the interpreter.
+static void VerifyStandardTemplate(benchmark::State& state, StandardTemplate type, bool fInterpreted)
+{
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S |
+                               SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLDUMMY | SCRIPT_VERIFY_NULLFAIL |
+                               SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK;
+    std::vector<CKey> keys(3);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+    std::vector<unsigned char> vchSig;
+    keys[0].Sign(GetRandHash(), vchSig);
+    vchSig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+
+    CScript scriptSig, scriptPubKey;
+    if (type == StandardTemplate::P2PKH) {
+        scriptPubKey = GetScriptForDestination(keys[0].GetPubKey().GetID());
+        scriptSig << vchSig << ToByteVector(keys[0].GetPubKey());
+    } else if (type == StandardTemplate::P2PK) {
+        scriptPubKey = GetScriptForRawPubKey(keys[0].GetPubKey());
+        scriptSig << vchSig;
+    } else {
+        std::vector<CPubKey> pubkeys;
+        for (const CKey& key : keys) {
+            pubkeys.push_back(key.GetPubKey());
+        }
+        const CScript redeemScript = GetScriptForMultisig(2, pubkeys);
+        scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+        scriptSig << OP_0 << vchSig << vchSig << ToByteVector(redeemScript);
+    }
+
+    const AcceptingSignatureChecker checker;
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = fInterpreted ? VerifyScriptInterpreted(scriptSig, scriptPubKey, nullptr, flags, checker, &err)
+                                    : VerifyScript(scriptSig, scriptPubKey, nullptr, flags, checker, &err);
+        assert(success);
+    }
+}
+
+static void VerifyP2PKHInterpreted(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2PKH, true); }
+static void VerifyP2PKHStandard(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2PKH, false); }
+static void VerifyP2PKInterpreted(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2PK, true); }
+static void VerifyP2PKStandard(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2PK, false); }
+static void VerifyP2SHMultisigInterpreted(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2SH_MULTISIG, true); }
+static void VerifyP2SHMultisigStandard(benchmark::State& state) { VerifyStandardTemplate(state, StandardTemplate::P2SH_MULTISIG, false); }
+
+BENCHMARK(VerifyBlockSignatureSerial);
+BENCHMARK(VerifyBlockSignatureQueued);
+BENCHMARK(VerifyPoSRange);
+BENCHMARK(SignatureHashLegacySerializer);
+BENCHMARK(SignatureHashLegacyPrecomputed);
+BENCHMARK(VerifyP2PKHInterpreted);
+BENCHMARK(VerifyP2PKHStandard);
+BENCHMARK(VerifyP2PKInterpreted);
+BENCHMARK(VerifyP2PKStandard);
+BENCHMARK(VerifyP2SHMultisigInterpreted);
+BENCHMARK(VerifyP2SHMultisigStandard);
@@ -13,7 +13,6 @@
 #include "validation.h"
 #include "util.h"
 
-#include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
@@ -43,7 +42,33 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+const uint64_t ShortTxIDIndex::EMPTY_SLOT;
+
+ShortTxIDIndex::ShortTxIDIndex(size_t nElements) :
+        nSalt(GetRand(std::numeric_limits<uint64_t>::max()) | 1), nShift(64), nCount(0) {
+    // Keep the table at most a quarter full so that misses end on an empty slot quickly
+    size_t nSlots = 1;
+    do {
+        nSlots <<= 1;
+        nShift--;
+    } while (nSlots < nElements * 4 || nSlots < 16);
+    vKeys.assign(nSlots, EMPTY_SLOT);
+    vIndex.resize(nSlots);
+}
 
+bool ShortTxIDIndex::Insert(uint64_t shortid, uint16_t index) {
+    assert(shortid != EMPTY_SLOT && nCount < vKeys.size() / 2);
+    size_t pos = Slot(shortid);
+    while (vKeys[pos] != EMPTY_SLOT) {
+        if (vKeys[pos] == shortid)
+            return false;
+        pos = (pos + 1) & (vKeys.size() - 1);
+    }
+    vKeys[pos] = shortid;
+    vIndex[pos] = index;
+    nCount++;
+    return true;
+}
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
     if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
@@ -73,52 +98,37 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     }
     prefilled_count = cmpctblock.prefilledtxn.size();
 
-    // Calculate map of txids -> positions and check mempool to see what we have (or don't)
-    // Because well-formed cmpctblock messages will have a (relatively) uniform distribution
-    // of short IDs, any highly-uneven distribution of elements can be safely treated as a
-    // READ_STATUS_FAILED.
-    std::unordered_map<uint64_t, uint16_t> shorttxids(cmpctblock.shorttxids.size());
+    // Calculate map of short ids -> positions and check mempool to see what we have (or don't).
+    // The index is salted, so a peer cannot make its lookups degenerate by picking short ids.
+    ShortTxIDIndex shorttxids(cmpctblock.shorttxids.size());
     uint16_t index_offset = 0;
     for (size_t i = 0; i < cmpctblock.shorttxids.size(); i++) {
         while (txn_available[i + index_offset])
             index_offset++;
-        shorttxids[cmpctblock.shorttxids[i]] = i + index_offset;
-        // To determine the chance that the number of entries in a bucket exceeds N,
-        // we use the fact that the number of elements in a single bucket is
-        // binomially distributed (with n = the number of shorttxids S, and p =
-        // 1 / the number of buckets), that in the worst case the number of buckets is
-        // equal to S (due to std::unordered_map having a default load factor of 1.0),
-        // and that the chance for any bucket to exceed N elements is at most
-        // buckets * (the chance that any given bucket is above N elements).
-        // Thus: P(max_elements_per_bucket > N) <= S * (1 - cdf(binomial(n=S,p=1/S), N)).
-        // If we assume blocks of up to 16000, allowing 12 elements per bucket should
-        // only fail once per ~1 million block transfers (per peer and connection).
-        if (shorttxids.bucket_size(shorttxids.bucket(cmpctblock.shorttxids[i])) > 12)
-            return READ_STATUS_FAILED;
+        // TODO: in the shortid-collision case, we should instead request both transactions
+        // which collided. Falling back to full-block-request here is overkill.
+        if (!shorttxids.Insert(cmpctblock.shorttxids[i], i + index_offset))
+            return READ_STATUS_FAILED; // Short ID collision
     }
-    // TODO: in the shortid-collision case, we should instead request both transactions
-    // which collided. Falling back to full-block-request here is overkill.
-    if (shorttxids.size() != cmpctblock.shorttxids.size())
-        return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
+    uint16_t idx;
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
     for (size_t i = 0; i < vTxHashes.size(); i++) {
         uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+        if (shorttxids.Find(shortid, idx)) {
+            if (!have_txn[idx]) {
+                txn_available[idx] = vTxHashes[i].second->GetSharedTx();
+                have_txn[idx]  = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (txn_available[idx]) {
+                    txn_available[idx].reset();
                     mempool_count--;
                 }
             }
@@ -133,11 +143,10 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
 
     for (size_t i = 0; i < extra_txn.size(); i++) {
         uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = extra_txn[i].second;
-                have_txn[idit->second]  = true;
+        if (shorttxids.Find(shortid, idx)) {
+            if (!have_txn[idx]) {
+                txn_available[idx] = extra_txn[i].second;
+                have_txn[idx]  = true;
                 mempool_count++;
                 extra_count++;
             } else {
@@ -147,9 +156,9 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
                 // but eating a round-trip due to FillBlock failure would be annoying
                 // Note that we don't want duplication between extra_txn and mempool to
                 // trigger this case, so we compare witness hashes first
-                if (txn_available[idit->second] &&
-                        txn_available[idit->second]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
-                    txn_available[idit->second].reset();
+                if (txn_available[idx] &&
+                        txn_available[idx]->GetWitnessHash() != extra_txn[i].second->GetWitnessHash()) {
+                    txn_available[idx].reset();
                     mempool_count--;
                     extra_count--;
                 }
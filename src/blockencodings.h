@@ -8,6 +8,7 @@
 #include "primitives/block.h"
 
 #include <memory>
+#include <vector>
 
 class CTxMemPool;
 
@@ -191,6 +192,47 @@ public:
     }
 };
 
+/**
+ * Open-addressed table from the short IDs of a compact block to the positions
+ * they fill in that block. Reconstruction probes it once for every mempool
+ * transaction and nearly all of those probes miss, so it is kept as a flat,
+ * sparsely loaded array of keys instead of a node-based map. Short IDs are
+ * only 48 bits wide, which leaves all-ones free to mark an empty slot. Slots
+ * are picked by a multiplicative hash with a random salt, so a peer cannot
+ * choose short IDs that pile up in one region of the table.
+ */
+class ShortTxIDIndex {
+private:
+    static const uint64_t EMPTY_SLOT = ~(uint64_t)0;
+
+    std::vector<uint64_t> vKeys;
+    std::vector<uint16_t> vIndex;
+    uint64_t nSalt;
+    int nShift;
+    size_t nCount;
+
+    size_t Slot(uint64_t shortid) const { return (shortid * nSalt) >> nShift; }
+
+public:
+    explicit ShortTxIDIndex(size_t nElements);
+
+    //! Add a short ID, returns false if it was already present
+    bool Insert(uint64_t shortid, uint16_t index);
+    //! Look up the block position for a short ID, returns false if it is unknown
+    bool Find(uint64_t shortid, uint16_t& index) const
+    {
+        for (size_t pos = Slot(shortid); ; pos = (pos + 1) & (vKeys.size() - 1)) {
+            if (vKeys[pos] == shortid) {
+                index = vIndex[pos];
+                return true;
+            }
+            if (vKeys[pos] == EMPTY_SLOT)
+                return false;
+        }
+    }
+    size_t size() const { return nCount; }
+};
+
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txn_available;
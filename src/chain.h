@@ -231,6 +231,7 @@ public:
         BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
         BLOCK_STAKE_ENTROPY  = (1 << 1), // entropy bit for stake modifier
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
+        BLOCK_SIGNATURE_VALID = (1 << 3), // block signature checked when the block was received
     };
 
     uint256 bnStakeModifierV2; // hash modifier for proof-of-stake
@@ -8,6 +8,8 @@
 #include "sync.h"
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -16,6 +18,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+//! Number of per-thread deques in a CCheckQueue (including the master's)
+static const unsigned int MAX_CHECKQUEUE_DEQUES = 65;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +30,25 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread has its own deque of pending verifications, which the
+  * master fills round-robin. A thread takes work from the back of its own
+  * deque and, once that runs dry, steals from the front of the others, so
+  * workers keep busy without contending on one shared lock while the
+  * master is still adding.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! The verifications assigned to one thread
+    struct WorkerQueue {
+        boost::mutex mutex;
+        //! Owner takes from the back, thieves from the front
+        std::deque<T> checks;
+    };
+
+    //! Mutex to protect sleeping and waking up threads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +57,28 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! One deque per thread; the master uses the first. Threads beyond the
+    //! number of deques share them.
+    std::vector<WorkerQueue> vQueues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads (excluding the master) ever started.
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Deque the next batch added by the master starts filling.
+    unsigned int nNextQueue;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications still sitting in one of the deques.
+    std::atomic<unsigned int> nQueued;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,32 +86,68 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Number of deques currently in use.
+    unsigned int ActiveQueues() const
+    {
+        return std::min<unsigned int>(nWorkers.load() + 1, vQueues.size());
+    }
+
+    /**
+     * Move up to half (at most nBatchSize, at least one) of the checks in
+     * queue into vChecks. Shrinking batches let all threads finish at about
+     * the same time.
+     */
+    bool Take(WorkerQueue& queue, std::vector<T>& vChecks, bool fOwn)
+    {
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        if (queue.checks.empty())
+            return false;
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.checks.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs out of the deque instead of copying, so the lock is
+            // held as briefly as possible.
+            if (fOwn) {
+                vChecks[i].swap(queue.checks.back());
+                queue.checks.pop_back();
+            } else {
+                vChecks[i].swap(queue.checks.front());
+                queue.checks.pop_front();
+            }
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    //! Take a batch from our own deque, or steal one from another thread.
+    bool TakeAny(unsigned int nQueue, std::vector<T>& vChecks)
+    {
+        if (nQueued == 0)
+            return false;
+        if (Take(vQueues[nQueue], vChecks, true))
+            return true;
+        const unsigned int nActive = ActiveQueues();
+        for (unsigned int i = 1; i < nActive; i++) {
+            if (Take(vQueues[(nQueue + i) % nActive], vChecks, false))
+                return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const unsigned int nQueue = fMaster ? 0 : 1 + nWorkers++ % (vQueues.size() - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
+            if (!TakeAny(nQueue, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
+                // Checks still counted as queued are being pushed by the
+                // master right now; retry instead of sleeping.
+                if (nQueued == 0) {
                     if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
                         bool fRet = fAllOk;
                         // reset the status for new work later
                         if (fMaster)
@@ -98,31 +155,26 @@ private:
                         // return the current status
                         return fRet;
                     }
-                    nIdle++;
                     cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            const unsigned int nNow = vChecks.size();
+            // Destroy the checks before reporting them done
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -131,7 +183,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : vQueues(MAX_CHECKQUEUE_DEQUES), nWorkers(0), nNextQueue(0), fAllOk(true), nTodo(0), nQueued(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -148,15 +200,26 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
+        nQueued += vChecks.size();
+        // Spread the batch over the threads' deques
+        const unsigned int nActive = ActiveQueues();
+        const size_t nChunk = (vChecks.size() + nActive - 1) / nActive;
+        size_t i = 0;
+        while (i < vChecks.size()) {
+            WorkerQueue& queue = vQueues[nNextQueue++ % nActive];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t end = std::min(i + nChunk, vChecks.size()); i < end; i++) {
+                queue.checks.emplace_back();
+                queue.checks.back().swap(vChecks[i]);
+            }
+        }
+        boost::unique_lock<boost::mutex> lock(mutex);
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -11,7 +11,6 @@
 
 #if defined(__x86_64__) || defined(__amd64__)
 #if defined(EXPERIMENTAL_ASM)
-#include <cpuid.h>
 namespace sha256_sse4
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
@@ -19,6 +18,26 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 #endif
 #endif
 
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+
+namespace sha256d64_shani
+{
+void Transform_2way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -174,21 +193,122 @@ bool SelfTest(TransformType tr) {
 
 TransformType Transform = sha256::Transform;
 
+/** Double-SHA256 of a 64-byte input through the selected Transform. */
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char pad64[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0};
+    uint32_t s[8];
+    unsigned char buf[64] = {0};
+    sha256::Initialize(s);
+    Transform(s, in, 1);
+    Transform(s, pad64, 1);
+    for (int i = 0; i < 8; i++) WriteBE32(buf + 4 * i, s[i]);
+    buf[32] = 0x80;
+    buf[62] = 1;
+    sha256::Initialize(s);
+    Transform(s, buf, 1);
+    for (int i = 0; i < 8; i++) WriteBE32(out + 4 * i, s[i]);
+}
+
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Multi-way double-SHA256 of 64-byte inputs, where available. */
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+/** Check an N-way TransformD64 against N single double-SHA256 computations. */
+bool SelfTestD64(TransformD64Type tr, int ways)
+{
+    unsigned char in[64 * 8];
+    unsigned char out[32 * 8];
+    unsigned char expected[32];
+    for (size_t i = 0; i < sizeof(in); i++) in[i] = (unsigned char)(i * 7 + 1);
+    tr(out, in);
+    for (int l = 0; l < ways; l++) {
+        CSHA256().Write(in + 64 * l, 64).Finalize(expected);
+        CSHA256().Write(expected, 32).Finalize(expected);
+        if (memcmp(out + 32 * l, expected, 32)) return false;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__amd64__)
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+}
+
+/** Whether the OS saves the AVX register state on context switches. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
 std::string SHA256AutoDetect()
 {
-#if defined(EXPERIMENTAL_ASM) && (defined(__x86_64__) || defined(__amd64__))
+    std::string ret = "standard";
+#if defined(__x86_64__) || defined(__amd64__)
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    const uint32_t nMaxLeaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    bool have_sse4 = (ecx >> 19) & 1;
+    const bool have_xsave = ((ecx >> 27) & 1) && ((ecx >> 26) & 1);
+    const bool have_avx = have_xsave && ((ecx >> 28) & 1) && AVXEnabled();
+    bool have_avx2 = false, have_shani = false;
+    if (nMaxLeaf >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = have_avx && ((ebx >> 5) & 1);
+        have_shani = (ebx >> 29) & 1;
+    }
+    (void)have_sse4;
+    (void)have_avx2;
+    (void)have_shani;
+
+#if defined(EXPERIMENTAL_ASM)
+    if (have_sse4) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        ret = "sse4(1way)";
     }
 #endif
 
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_shani && have_sse4) {
+        Transform = sha256_shani::Transform;
+        TransformD64_2way = sha256d64_shani::Transform_2way;
+        ret = "shani(1way,2way)";
+        // Two interleaved SHA-NI streams outrun the SIMD lanes; leave those off.
+        have_sse4 = have_avx2 = false;
+    }
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_sse4) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
     assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTestD64(TransformD64, 1));
+    if (TransformD64_2way) assert(SelfTestD64(TransformD64_2way, 2));
+    if (TransformD64_4way) assert(SelfTestD64(TransformD64_4way, 4));
+    if (TransformD64_8way) assert(SelfTestD64(TransformD64_8way, 8));
+    return ret;
 }
 
 ////// SHA-256
@@ -247,3 +367,37 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -26,6 +26,14 @@ public:
     CSHA256& Reset();
 };
 
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  The output may overlap the start of the input.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 /** Autodetect the best available SHA256 implementation.
  *  Returns the name of the implementation.
  */
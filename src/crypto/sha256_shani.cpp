@@ -0,0 +1,184 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 using the Intel SHA extensions, for a single stream and for a
+// 2-way double-SHA256 of 64-byte inputs whose rounds are interleaved.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace {
+
+alignas(16) const uint32_t k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+alignas(16) const uint32_t init[8] = {0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul};
+
+/** Load 16 big endian bytes. */
+__m128i inline LoadBE(const unsigned char* in)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull));
+}
+
+/** Store 16 bytes big endian. */
+void inline StoreBE(unsigned char* out, __m128i v)
+{
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(v, _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull)));
+}
+
+/** Convert the state from a..h word order to the ABEF/CDGH halves sha256rnds2 works on. */
+void inline Unpack(const uint32_t* s, __m128i& abef, __m128i& cdgh)
+{
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1B);
+    abef = _mm_alignr_epi8(cdab, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+}
+
+/** Inverse of Unpack. */
+void inline Pack(__m128i abef, __m128i cdgh, __m128i& abcd, __m128i& efgh)
+{
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    abcd = _mm_blend_epi16(feba, dchg, 0xF0);
+    efgh = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+/** Four rounds, with message words m (4j..4j+3). */
+void inline QuadRound(__m128i& abef, __m128i& cdgh, __m128i m, int j)
+{
+    __m128i wk = _mm_add_epi32(m, _mm_load_si128((const __m128i*)(k256 + 4 * j)));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+}
+
+/** The next four message words, from the sixteen before them (m0 oldest). */
+__m128i inline Expand(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    return _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3);
+}
+
+/** Perform one SHA-256 transformation on a block of message words m0..m3. */
+void inline Transform(__m128i& abef, __m128i& cdgh, __m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    const __m128i abef_save = abef, cdgh_save = cdgh;
+    QuadRound(abef, cdgh, m0, 0);
+    QuadRound(abef, cdgh, m1, 1);
+    QuadRound(abef, cdgh, m2, 2);
+    QuadRound(abef, cdgh, m3, 3);
+    for (int j = 4; j < 16; j += 4) {
+        m0 = Expand(m0, m1, m2, m3);
+        QuadRound(abef, cdgh, m0, j);
+        m1 = Expand(m1, m2, m3, m0);
+        QuadRound(abef, cdgh, m1, j + 1);
+        m2 = Expand(m2, m3, m0, m1);
+        QuadRound(abef, cdgh, m2, j + 2);
+        m3 = Expand(m3, m0, m1, m2);
+        QuadRound(abef, cdgh, m3, j + 3);
+    }
+    abef = _mm_add_epi32(abef, abef_save);
+    cdgh = _mm_add_epi32(cdgh, cdgh_save);
+}
+
+/** Two independent transformations (a and b), with their rounds interleaved. */
+void inline Transform2(__m128i& abef_a, __m128i& cdgh_a, __m128i a0, __m128i a1, __m128i a2, __m128i a3,
+                       __m128i& abef_b, __m128i& cdgh_b, __m128i b0, __m128i b1, __m128i b2, __m128i b3)
+{
+    const __m128i abef_a_save = abef_a, cdgh_a_save = cdgh_a, abef_b_save = abef_b, cdgh_b_save = cdgh_b;
+    QuadRound(abef_a, cdgh_a, a0, 0);
+    QuadRound(abef_b, cdgh_b, b0, 0);
+    QuadRound(abef_a, cdgh_a, a1, 1);
+    QuadRound(abef_b, cdgh_b, b1, 1);
+    QuadRound(abef_a, cdgh_a, a2, 2);
+    QuadRound(abef_b, cdgh_b, b2, 2);
+    QuadRound(abef_a, cdgh_a, a3, 3);
+    QuadRound(abef_b, cdgh_b, b3, 3);
+    for (int j = 4; j < 16; j += 4) {
+        a0 = Expand(a0, a1, a2, a3);
+        b0 = Expand(b0, b1, b2, b3);
+        QuadRound(abef_a, cdgh_a, a0, j);
+        QuadRound(abef_b, cdgh_b, b0, j);
+        a1 = Expand(a1, a2, a3, a0);
+        b1 = Expand(b1, b2, b3, b0);
+        QuadRound(abef_a, cdgh_a, a1, j + 1);
+        QuadRound(abef_b, cdgh_b, b1, j + 1);
+        a2 = Expand(a2, a3, a0, a1);
+        b2 = Expand(b2, b3, b0, b1);
+        QuadRound(abef_a, cdgh_a, a2, j + 2);
+        QuadRound(abef_b, cdgh_b, b2, j + 2);
+        a3 = Expand(a3, a0, a1, a2);
+        b3 = Expand(b3, b0, b1, b2);
+        QuadRound(abef_a, cdgh_a, a3, j + 3);
+        QuadRound(abef_b, cdgh_b, b3, j + 3);
+    }
+    abef_a = _mm_add_epi32(abef_a, abef_a_save);
+    cdgh_a = _mm_add_epi32(cdgh_a, cdgh_a_save);
+    abef_b = _mm_add_epi32(abef_b, abef_b_save);
+    cdgh_b = _mm_add_epi32(cdgh_b, cdgh_b_save);
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i abef, cdgh, abcd, efgh;
+
+    Unpack(s, abef, cdgh);
+    while (blocks--) {
+        ::Transform(abef, cdgh, LoadBE(chunk), LoadBE(chunk + 16), LoadBE(chunk + 32), LoadBE(chunk + 48));
+        chunk += 64;
+    }
+    Pack(abef, cdgh, abcd, efgh);
+    _mm_storeu_si128((__m128i*)s, abcd);
+    _mm_storeu_si128((__m128i*)(s + 4), efgh);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i abef_a, cdgh_a, abef_b, cdgh_b;
+    __m128i a0, a1, b0, b1;
+    const __m128i pad64_0 = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+    const __m128i pad64_3 = _mm_set_epi32(512, 0, 0, 0);
+    const __m128i pad32_3 = _mm_set_epi32(256, 0, 0, 0);
+    const __m128i zero = _mm_setzero_si128();
+
+    // The 64-byte inputs.
+    Unpack(init, abef_a, cdgh_a);
+    Unpack(init, abef_b, cdgh_b);
+    Transform2(abef_a, cdgh_a, LoadBE(in), LoadBE(in + 16), LoadBE(in + 32), LoadBE(in + 48),
+               abef_b, cdgh_b, LoadBE(in + 64), LoadBE(in + 80), LoadBE(in + 96), LoadBE(in + 112));
+
+    // Their padding.
+    Transform2(abef_a, cdgh_a, pad64_0, zero, zero, pad64_3, abef_b, cdgh_b, pad64_0, zero, zero, pad64_3);
+
+    // The padded 32-byte digests of those, hashed again.
+    Pack(abef_a, cdgh_a, a0, a1);
+    Pack(abef_b, cdgh_b, b0, b1);
+    Unpack(init, abef_a, cdgh_a);
+    Unpack(init, abef_b, cdgh_b);
+    Transform2(abef_a, cdgh_a, a0, a1, pad64_0, pad32_3, abef_b, cdgh_b, b0, b1, pad64_0, pad32_3);
+
+    Pack(abef_a, cdgh_a, a0, a1);
+    Pack(abef_b, cdgh_b, b0, b1);
+    StoreBE(out, a0);
+    StoreBE(out + 16, a1);
+    StoreBE(out + 32, b0);
+    StoreBE(out + 48, b1);
+}
+} // namespace sha256d64_shani
+
+#endif
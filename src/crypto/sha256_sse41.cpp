@@ -0,0 +1,146 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// 4-way double-SHA256 of 64-byte inputs, one input per 32-bit SSE lane.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_sse41 {
+namespace {
+
+__m128i inline K(uint32_t x) { return _mm_set1_epi32(x); }
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+__m128i inline And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+__m128i inline ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+__m128i inline ShL(__m128i x, int n) { return _mm_slli_epi32(x, n); }
+
+__m128i inline Ch(__m128i x, __m128i y, __m128i z) { return Xor(z, And(x, Xor(y, z))); }
+__m128i inline Maj(__m128i x, __m128i y, __m128i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m128i inline Sigma0(__m128i x) { return Xor(Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19))), Or(ShR(x, 22), ShL(x, 10))); }
+__m128i inline Sigma1(__m128i x) { return Xor(Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21))), Or(ShR(x, 25), ShL(x, 7))); }
+__m128i inline sigma0(__m128i x) { return Xor(Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14))), ShR(x, 3)); }
+__m128i inline sigma1(__m128i x) { return Xor(Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13))), ShR(x, 10)); }
+
+/** One round of SHA-256. */
+void inline Round(__m128i a, __m128i b, __m128i c, __m128i& d, __m128i e, __m128i f, __m128i g, __m128i& h, __m128i k)
+{
+    __m128i t1 = Add(Add(h, Sigma1(e)), Add(Ch(e, f, g), k));
+    __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Message word i of the block in w, expanding the 16-word window in place. */
+__m128i inline W(__m128i* w, int i)
+{
+    if (i >= 16) {
+        w[i & 15] = Add(Add(w[i & 15], sigma1(w[(i + 14) & 15])), Add(w[(i + 9) & 15], sigma0(w[(i + 1) & 15])));
+    }
+    return w[i & 15];
+}
+
+const uint32_t k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Initialize the SHA-256 state in every lane. */
+void inline Initialize(__m128i* s)
+{
+    s[0] = K(0x6a09e667ul);
+    s[1] = K(0xbb67ae85ul);
+    s[2] = K(0x3c6ef372ul);
+    s[3] = K(0xa54ff53aul);
+    s[4] = K(0x510e527ful);
+    s[5] = K(0x9b05688cul);
+    s[6] = K(0x1f83d9abul);
+    s[7] = K(0x5be0cd19ul);
+}
+
+/** Perform one SHA-256 transformation in every lane. Clobbers w. */
+void inline Transform(__m128i* s, __m128i* w)
+{
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i += 8) {
+        Round(a, b, c, d, e, f, g, h, Add(K(k256[i + 0]), W(w, i + 0)));
+        Round(h, a, b, c, d, e, f, g, Add(K(k256[i + 1]), W(w, i + 1)));
+        Round(g, h, a, b, c, d, e, f, Add(K(k256[i + 2]), W(w, i + 2)));
+        Round(f, g, h, a, b, c, d, e, Add(K(k256[i + 3]), W(w, i + 3)));
+        Round(e, f, g, h, a, b, c, d, Add(K(k256[i + 4]), W(w, i + 4)));
+        Round(d, e, f, g, h, a, b, c, Add(K(k256[i + 5]), W(w, i + 5)));
+        Round(c, d, e, f, g, h, a, b, Add(K(k256[i + 6]), W(w, i + 6)));
+        Round(b, c, d, e, f, g, h, a, Add(K(k256[i + 7]), W(w, i + 7)));
+    }
+
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Load big endian word i of each of the 4 consecutive 64-byte inputs. */
+__m128i inline Read4(const unsigned char* in, int i)
+{
+    return _mm_set_epi32(ReadBE32(in + 192 + 4 * i), ReadBE32(in + 128 + 4 * i), ReadBE32(in + 64 + 4 * i), ReadBE32(in + 4 * i));
+}
+
+/** Store word i of each lane big endian into 4 consecutive 32-byte outputs. */
+void inline Write4(unsigned char* out, int i, __m128i v)
+{
+    WriteBE32(out + 4 * i, _mm_extract_epi32(v, 0));
+    WriteBE32(out + 32 + 4 * i, _mm_extract_epi32(v, 1));
+    WriteBE32(out + 64 + 4 * i, _mm_extract_epi32(v, 2));
+    WriteBE32(out + 96 + 4 * i, _mm_extract_epi32(v, 3));
+}
+
+} // namespace
+
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m128i s[8], w[16];
+
+    // The 64-byte input.
+    Initialize(s);
+    for (int i = 0; i < 16; i++) w[i] = Read4(in, i);
+    Transform(s, w);
+
+    // Its padding.
+    w[0] = K(0x80000000ul);
+    for (int i = 1; i < 15; i++) w[i] = K(0);
+    w[15] = K(512);
+    Transform(s, w);
+
+    // The padded 32-byte digest of that, hashed again.
+    for (int i = 0; i < 8; i++) w[i] = s[i];
+    w[8] = K(0x80000000ul);
+    for (int i = 9; i < 15; i++) w[i] = K(0);
+    w[15] = K(256);
+    Initialize(s);
+    Transform(s, w);
+
+    for (int i = 0; i < 8; i++) Write4(out, i, s[i]);
+}
+
+} // namespace sha256d64_sse41
+
+#endif
@@ -475,6 +475,21 @@ public:
             }
         return false;
     }
+
+    /** for_each calls f on every element that is not marked for garbage
+     * collection, e.g. to write the cache to disk.
+     *
+     * for_each is not threadsafe with respect to insert.
+     *
+     * @param f a callable taking a const Element&
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
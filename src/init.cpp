@@ -118,6 +118,7 @@ static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
 
 std::atomic<bool> fRequestShutdown(false);
 std::atomic<bool> fDumpMempoolLater(false);
+static std::atomic<bool> fDumpSigCacheLater(false);
 
 void StartShutdown()
 {
@@ -206,6 +207,10 @@ void Shutdown()
     if (fDumpMempoolLater && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         DumpMempool();
     }
+    if (fDumpSigCacheLater) {
+        DumpSignatureCache();
+        DumpScriptExecutionCache();
+    }
 
     if (fFeeEstimatesInitialized)
     {
@@ -369,9 +374,10 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
     }
-    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool periodically and on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistsigcache", strprintf(_("Whether to save the signature and script execution caches on shutdown and load them on restart (default: %u)"), DEFAULT_PERSIST_SIGCACHE));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads, and of threads checking the transactions of new blocks (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
@@ -702,6 +708,20 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
     }
 }
 
+// Keep mempool.dat recent, so that an unclean shutdown loses little of the mempool
+static void PeriodicDumpMempool()
+{
+    // Wait for LoadMempool, and skip the dump if nothing changed since the last one
+    static unsigned int nLastTransactionsUpdated = 0;
+    if (!fDumpMempoolLater)
+        return;
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    if (nTransactionsUpdated == nLastTransactionsUpdated)
+        return;
+    nLastTransactionsUpdated = nTransactionsUpdated;
+    DumpMempool();
+}
+
 /** Sanity checks
  *  Ensure that Bitcoin is running in a usable environment with all
  *  necessary library support.
@@ -1247,11 +1267,21 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCache();
+        LoadScriptExecutionCache();
+        fDumpSigCacheLater = true;
+    }
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    // Each script check thread has a block check thread next to it. New blocks
+    // are checked outside cs_main, possibly while ConnectBlock has the script
+    // check queue busy, so the two do not share workers.
+    LogPrintf("Using %u threads for script verification and %u for block transaction checks\n", nScriptCheckThreads, nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBlockCheck);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1652,6 +1682,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        scheduler.scheduleEvery(PeriodicDumpMempool, DUMP_MEMPOOL_INTERVAL * 1000);
+    }
+
     // Wait for genesis block to be processed
     {
         boost::unique_lock<boost::mutex> lock(cs_GenesisWait);
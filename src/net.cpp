@@ -667,6 +667,8 @@ void CNode::copyStats(CNodeStats &stats)
     {
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
+        X(mapSendCountPerMsgCmd);
+        X(mapSendTimePerMsgCmd);
         X(nSendBytes);
     }
     {
@@ -841,33 +843,82 @@ const uint256& CNetMessage::GetMessageHash() const
 
 
 
+SendPriority GetSendPriority(const std::string& command)
+{
+    // Connection control, our own requests and block announcements may overtake
+    // queued blocks. Everything else keeps the order it was queued in: BIP37
+    // clients use pong as a barrier meaning all their earlier getdata has been
+    // answered, and the inv that trails the last block of a getblocks batch
+    // must not arrive before that block.
+    if (command == NetMsgType::VERSION || command == NetMsgType::VERACK || command == NetMsgType::PING ||
+        command == NetMsgType::SENDHEADERS || command == NetMsgType::SENDCMPCT || command == NetMsgType::FEEFILTER ||
+        command == NetMsgType::GETADDR || command == NetMsgType::GETBLOCKS || command == NetMsgType::GETHEADERS ||
+        command == NetMsgType::GETDATA || command == NetMsgType::GETBLOCKTXN || command == NetMsgType::BLOCKTXN ||
+        command == NetMsgType::HEADERS || command == NetMsgType::CMPCTBLOCK)
+        return SEND_PRIORITY_ANNOUNCE;
+    return SEND_PRIORITY_ORDERED;
+}
+
 // requires LOCK(cs_vSend)
-size_t CConnman::SocketSendData(CNode *pnode) const
+size_t CConnman::SocketSendData(CNode *pnode)
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
+    size_t nOrderedSize = 0;
+
+    while (true) {
+        int nQueue = pnode->nSendQueue;
+        if (nQueue < 0) {
+            nQueue = 0;
+            while (nQueue < SEND_PRIORITY_COUNT && pnode->vSendMsg[nQueue].empty())
+                nQueue++;
+            if (nQueue == SEND_PRIORITY_COUNT)
+                break;
+        }
+        size_t nMaxSend = std::numeric_limits<size_t>::max();
+        if (nQueue == SEND_PRIORITY_ORDERED) {
+            // Leave the rest for the next pass, after the other peers had their turn
+            if (nOrderedSize >= SEND_ORDERED_QUANTUM)
+                break;
+            nMaxSend = SEND_ORDERED_QUANTUM - nOrderedSize;
+        }
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        CSendMsg& msg = pnode->vSendMsg[nQueue].front();
+        assert(msg.size() > pnode->nSendOffset);
+        const bool fHeader = pnode->nSendOffset < msg.header.size();
+        const std::vector<unsigned char>& data = fHeader ? msg.header : msg.data;
+        const size_t nDataOffset = fHeader ? pnode->nSendOffset : pnode->nSendOffset - msg.header.size();
+        const size_t nDataSize = std::min(data.size() - nDataOffset, nMaxSend);
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + nDataOffset, nDataSize, MSG_NOSIGNAL | MSG_DONTWAIT);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
+            pnode->nSendQueue = nQueue;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            if (nQueue == SEND_PRIORITY_ORDERED)
+                nOrderedSize += nBytes;
+            if (pnode->nSendOffset == msg.size()) {
+                int64_t nQueueTime = GetTimeMicros() - msg.nTimeQueued;
+                pnode->mapSendCountPerMsgCmd[msg.command]++;
+                pnode->mapSendTimePerMsgCmd[msg.command] += nQueueTime;
+                {
+                    LOCK(cs_totalBytesSent);
+                    mapTotalSendBytesPerMsgCmd[msg.command] += msg.size();
+                    mapTotalSendCountPerMsgCmd[msg.command]++;
+                    mapTotalSendTimePerMsgCmd[msg.command] += nQueueTime;
+                }
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendQueue = -1;
+                pnode->nSendSize -= msg.size();
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
+                pnode->vSendMsg[nQueue].pop_front();
+            } else if ((size_t)nBytes < nDataSize) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -886,11 +937,10 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->IsSendQueueEmpty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1228,7 +1278,7 @@ void CConnman::ThreadSocketHandler()
                 bool select_send;
                 {
                     LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
+                    select_send = !pnode->IsSendQueueEmpty();
                 }
 
                 LOCK(pnode->cs_hSocket);
@@ -1329,10 +1379,20 @@ void CConnman::ThreadSocketHandler()
                     if (notify) {
                         size_t nSizeAdded = 0;
                         auto it(pnode->vRecvMsg.begin());
-                        for (; it != pnode->vRecvMsg.end(); ++it) {
-                            if (!it->complete())
-                                break;
-                            nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                        {
+                            LOCK(cs_totalBytesRecv);
+                            for (; it != pnode->vRecvMsg.end(); ++it) {
+                                if (!it->complete())
+                                    break;
+                                nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+
+                                // only count valid commands, as in CNode::ReceiveMsgBytes
+                                mapMsgCmdSize::iterator i = mapTotalRecvBytesPerMsgCmd.find(it->hdr.pchCommand);
+                                if (i == mapTotalRecvBytesPerMsgCmd.end())
+                                    i = mapTotalRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+                                assert(i != mapTotalRecvBytesPerMsgCmd.end());
+                                i->second += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+                            }
                         }
                         {
                             LOCK(pnode->cs_vProcessMsg);
@@ -2288,6 +2348,13 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     nTotalBytesRecv = 0;
     nTotalBytesSent = 0;
+    mapTotalRecvBytesPerMsgCmd.clear();
+    for (const std::string &msg : getAllNetMessageTypes())
+        mapTotalRecvBytesPerMsgCmd[msg] = 0;
+    mapTotalRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapTotalSendBytesPerMsgCmd.clear();
+    mapTotalSendCountPerMsgCmd.clear();
+    mapTotalSendTimePerMsgCmd.clear();
     nMaxOutboundTotalBytesSentInCycle = 0;
     nMaxOutboundCycleStartTime = 0;
 
@@ -2691,6 +2758,23 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+void CConnman::GetTotalBytesPerMsgCmd(mapMsgCmdSize& mapRecvBytes, mapMsgCmdSize& mapSendBytes)
+{
+    {
+        LOCK(cs_totalBytesRecv);
+        mapRecvBytes = mapTotalRecvBytesPerMsgCmd;
+    }
+    LOCK(cs_totalBytesSent);
+    mapSendBytes = mapTotalSendBytesPerMsgCmd;
+}
+
+void CConnman::GetTotalSendTimePerMsgCmd(mapMsgCmdSize& mapSendCount, mapMsgCmdSize& mapSendTime)
+{
+    LOCK(cs_totalBytesSent);
+    mapSendCount = mapTotalSendCountPerMsgCmd;
+    mapSendTime = mapTotalSendTimePerMsgCmd;
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2744,6 +2828,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    nSendQueue = -1;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2836,18 +2921,21 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
+    CSendMsg queued;
+    queued.header.reserve(CMessageHeader::HEADER_SIZE);
     uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(pnode->lastMsgStart, msg.command.c_str(), nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, queued.header, 0, hdr};
+    queued.data = std::move(msg.data);
+    queued.command = msg.command;
+    queued.nTimeQueued = GetTimeMicros();
 
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        bool optimisticSend(pnode->IsSendQueueEmpty());
 
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
@@ -2855,9 +2943,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg[GetSendPriority(msg.command)].push_back(std::move(queued));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -83,6 +83,9 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Bytes of ordered data (getdata responses and the like) sent to one peer per pass of the
+ *  socket handler, so that serving blocks to one peer does not keep the others waiting for the link. */
+static const size_t SEND_ORDERED_QUANTUM = 256 * 1000;
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -91,6 +94,8 @@ static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Defaul
 
 typedef int64_t NodeId;
 
+typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
+
 struct AddedNodeInfo
 {
     std::string strAddedNode;
@@ -298,6 +303,10 @@ public:
 
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
+    //! Bytes received and sent per message type, summed over all peers
+    void GetTotalBytesPerMsgCmd(mapMsgCmdSize& mapRecvBytes, mapMsgCmdSize& mapSendBytes);
+    //! Number of messages sent and the total time (in microseconds) they were queued for, per message type
+    void GetTotalSendTimePerMsgCmd(mapMsgCmdSize& mapSendCount, mapMsgCmdSize& mapSendTime);
 
     void SetBestHeight(int height);
     int GetBestHeight() const;
@@ -343,7 +352,7 @@ private:
 
     NodeId GetNewNodeId();
 
-    size_t SocketSendData(CNode *pnode) const;
+    size_t SocketSendData(CNode *pnode);
     //!check is the banlist has unwritten changes
     bool BannedSetIsDirty();
     //!set the "dirty" flag for the banlist
@@ -366,6 +375,10 @@ private:
     CCriticalSection cs_totalBytesSent;
     uint64_t nTotalBytesRecv;
     uint64_t nTotalBytesSent;
+    mapMsgCmdSize mapTotalRecvBytesPerMsgCmd; // protected by cs_totalBytesRecv
+    mapMsgCmdSize mapTotalSendBytesPerMsgCmd; // protected by cs_totalBytesSent
+    mapMsgCmdSize mapTotalSendCountPerMsgCmd; // protected by cs_totalBytesSent
+    mapMsgCmdSize mapTotalSendTimePerMsgCmd; // protected by cs_totalBytesSent
 
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle;
@@ -514,7 +527,6 @@ struct LocalServiceInfo {
 
 extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
-typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
 class CNodeStats
 {
@@ -534,6 +546,8 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendCountPerMsgCmd;
+    mapMsgCmdSize mapSendTimePerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
     bool fWhitelisted;
@@ -595,6 +609,27 @@ public:
 };
 
 
+/** Send queues of a peer, in the order they are drained */
+enum SendPriority {
+    SEND_PRIORITY_ANNOUNCE = 0, // block announcements, requests and connection control
+    SEND_PRIORITY_ORDERED,      // everything else, including all getdata responses and pong
+    SEND_PRIORITY_COUNT
+};
+
+/** Return the send queue a message of the given type is placed in */
+SendPriority GetSendPriority(const std::string& command);
+
+/** A serialized message waiting to be sent to a peer */
+struct CSendMsg
+{
+    std::vector<unsigned char> header;
+    std::vector<unsigned char> data;
+    std::string command;
+    int64_t nTimeQueued; // in microseconds
+
+    size_t size() const { return header.size() + data.size(); }
+};
+
 /** Information about a peer */
 class CNode
 {
@@ -605,9 +640,12 @@ public:
     ServiceFlags nServicesExpected;
     SOCKET hSocket;
     size_t nSendSize; // total size of all vSendMsg entries
-    size_t nSendOffset; // offset inside the first vSendMsg already sent
+    size_t nSendOffset; // offset inside the message currently being sent
+    int nSendQueue; // queue whose first message is partially sent, or -1
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    // Messages are taken from the most urgent non-empty queue, but one that
+    // has been partially written to the socket is always completed first.
+    std::deque<CSendMsg> vSendMsg[SEND_PRIORITY_COUNT];
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -662,6 +700,8 @@ public:
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendCountPerMsgCmd;
+    mapMsgCmdSize mapSendTimePerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
 public:
     CMessageHeader::MessageStartChars lastMsgStart{0, 0, 0, 0};
@@ -763,6 +803,16 @@ public:
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
 
+    // requires LOCK(cs_vSend)
+    bool IsSendQueueEmpty() const
+    {
+        for (const auto& queue : vSendMsg) {
+            if (!queue.empty())
+                return false;
+        }
+        return true;
+    }
+
     void SetRecvVersion(int nVersionIn)
     {
         nRecvVersion = nVersionIn;
@@ -105,6 +105,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -128,6 +129,89 @@ namespace {
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
+
+    /**
+     * Topological and fee-rate order of the transactions queued for relay, shared by all peers.
+     *
+     * Instead of every peer sorting its own inventory against the mempool on each trickle,
+     * the queued transactions are ranked in a single mempool pass at most once per
+     * INVENTORY_RELAY_ORDER_INTERVAL. Peers order their candidates by that rank alone and
+     * only look up the mempool for the transactions they actually announce. Candidates
+     * without a rank, because they were queued after the last rebuild or by a peer pass
+     * (wallet and RPC relay push straight to the peers), wait for the next rebuild.
+     * Candidates that were no longer in the mempool at the last rebuild are marked gone.
+     * Only txids are kept, and entries queued longer than INVENTORY_RELAY_ORDER_EXPIRY ago
+     * are dropped at the next rebuild.
+     *
+     * Protected by cs_main.
+     */
+    class TxRelayBatch {
+    private:
+        //! Transactions queued since the last rebuild, with the time they were queued.
+        std::map<uint256, int64_t> mapQueued;
+        //! Ranked and gone transactions, with the time they were queued.
+        std::vector<std::pair<uint256, int64_t>> vRanked;
+        //! Rank of each transaction in vRanked, or GONE.
+        std::unordered_map<uint256, size_t, SaltedTxidHasher> mapRank;
+        int64_t nLastRebuild = 0;
+
+    public:
+        static constexpr size_t NO_RANK = std::numeric_limits<size_t>::max();
+        static constexpr size_t GONE = NO_RANK - 1;
+
+        void Queue(const uint256& hash, int64_t nNow) {
+            mapQueued.emplace(hash, nNow);
+            // A transaction that came back to the mempool is no longer gone.
+            auto it = mapRank.find(hash);
+            if (it != mapRank.end() && it->second == GONE) {
+                mapRank.erase(it);
+            }
+        }
+
+        /** Re-rank the queued transactions against the mempool, unless that was done recently. */
+        void MaybeRebuild(const CTxMemPool& pool, int64_t nNow) {
+            if (mapQueued.empty() || nNow < nLastRebuild + INVENTORY_RELAY_ORDER_INTERVAL)
+                return;
+            nLastRebuild = nNow;
+
+            for (const auto& entry : vRanked) {
+                if (entry.second >= nNow - INVENTORY_RELAY_ORDER_EXPIRY) {
+                    mapQueued.emplace(entry.first, entry.second);
+                }
+            }
+            std::vector<uint256> vHashes;
+            vHashes.reserve(mapQueued.size());
+            for (const auto& entry : mapQueued) {
+                vHashes.push_back(entry.first);
+            }
+
+            std::vector<TxMempoolInfo> vInfo = pool.infoSorted(vHashes);
+            vRanked.clear();
+            vRanked.reserve(mapQueued.size());
+            mapRank.clear();
+            mapRank.reserve(mapQueued.size());
+            for (const TxMempoolInfo& info : vInfo) {
+                const uint256& hash = info.tx->GetHash();
+                mapRank.emplace(hash, vRanked.size());
+                vRanked.emplace_back(hash, mapQueued[hash]);
+            }
+            for (const auto& entry : mapQueued) {
+                if (mapRank.emplace(entry.first, GONE).second) {
+                    vRanked.push_back(entry);
+                }
+            }
+            mapQueued.clear();
+        }
+
+        /** Position of a transaction in relay order, GONE, or NO_RANK if it was not queued before the last rebuild. */
+        size_t GetRank(const uint256& hash) const {
+            auto it = mapRank.find(hash);
+            return it == mapRank.end() ? NO_RANK : it->second;
+        }
+    };
+    constexpr size_t TxRelayBatch::NO_RANK;
+    constexpr size_t TxRelayBatch::GONE;
+    TxRelayBatch g_relay_batch;
 } // namespace
 
 namespace {
@@ -178,6 +262,16 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Adaptive limit on nBlocksInFlight for regular block downloads from this peer.
+    int nBlocksInFlightLimit;
+    //! Number of requested full blocks received from this peer.
+    int nBlocksDownloaded;
+    //! Moving average of the time between requesting and receiving a block (in microseconds).
+    int64_t nBlockDownloadLatency;
+    //! Moving average of the block download rate (in bytes per second).
+    int64_t nBlockDownloadRate;
+    //! When the last requested block was received from this peer (in microseconds), or 0.
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -245,6 +339,11 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlocksInFlightLimit = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        nBlocksDownloaded = 0;
+        nBlockDownloadLatency = 0;
+        nBlockDownloadRate = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -344,7 +443,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -360,6 +459,54 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     return true;
 }
 
+// Requires cs_main.
+// Update the download metrics and the adaptive in-flight window of the peer a requested
+// block was received from. Must be called before MarkBlockAsReceived.
+void UpdateBlockDownloadStats(NodeId nodeid, const uint256& hash, size_t nBytes) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+
+    const int64_t nNow = GetTimeMicros();
+    const int64_t nTimeRequested = itInFlight->second.second->nTimeRequested;
+    const int64_t nLatency = std::max<int64_t>(nNow - nTimeRequested, 1);
+    // Blocks are pipelined, so measure the rate over the time since the previous block arrived
+    // rather than since this one was requested.
+    const int64_t nInterval = std::max<int64_t>(nNow - std::max(state->nLastBlockReceived, nTimeRequested), 1);
+    const int64_t nRate = (int64_t)(nBytes * 1000000.0 / nInterval);
+    if (state->nBlocksDownloaded == 0) {
+        state->nBlockDownloadLatency = nLatency;
+        state->nBlockDownloadRate = nRate;
+    } else {
+        // Exponential moving averages with a weight of 1/8 for the new sample.
+        state->nBlockDownloadLatency += (nLatency - state->nBlockDownloadLatency) / 8;
+        state->nBlockDownloadRate += (nRate - state->nBlockDownloadRate) / 8;
+    }
+    state->nBlocksDownloaded++;
+    state->nLastBlockReceived = nNow;
+
+    // Additive increase while the peer keeps up, multiplicative decrease when it doesn't.
+    if (nLatency < BLOCK_DOWNLOAD_TARGET_LATENCY) {
+        state->nBlocksInFlightLimit = std::min(state->nBlocksInFlightLimit + 1, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    } else {
+        state->nBlocksInFlightLimit = std::max(state->nBlocksInFlightLimit * 3 / 4, MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    }
+}
+
+// Requires cs_main.
+// Whether a block that has been in flight from peer stateStaller since nTimeRequested should
+// rather be fetched from peer stateFaster. Only peers with no blocks in flight take over.
+bool ShouldRerequestStalledBlock(const CNodeState *stateFaster, const CNodeState *stateStaller, int64_t nTimeRequested, int64_t nNow) {
+    if (stateFaster->nBlocksInFlight != 0 || stateFaster->nBlocksDownloaded == 0)
+        return false;
+    if (stateStaller->nBlocksDownloaded > 0 && stateStaller->nBlockDownloadLatency <= stateFaster->nBlockDownloadLatency)
+        return false;
+    // Only switch when the other peer would very likely have delivered the block by now.
+    return nNow - nTimeRequested > 2 * stateFaster->nBlockDownloadLatency;
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -455,7 +602,7 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const CBlockIndex*& pindexStalled, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -491,6 +638,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    const CBlockIndex *pindexWaitingFor = nullptr;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -526,6 +674,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -536,6 +685,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -552,6 +702,29 @@ void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds)
     if (state) state->m_last_block_announcement = time_in_seconds;
 }
 
+// These functions are used for testing the adaptive block download window and
+// the re-requesting of stalled blocks, see DoS_tests.cpp
+void SetBlockInFlight(NodeId node, const uint256& hash, int64_t nTimeRequested)
+{
+    LOCK(cs_main);
+    std::list<QueuedBlock>::iterator* pit = nullptr;
+    if (MarkBlockAsInFlight(node, hash, nullptr, &pit))
+        (*pit)->nTimeRequested = nTimeRequested;
+}
+
+void SetBlockReceived(NodeId node, const uint256& hash, size_t nBytes)
+{
+    LOCK(cs_main);
+    UpdateBlockDownloadStats(node, hash, nBytes);
+    MarkBlockAsReceived(hash);
+}
+
+bool ShouldRerequestStalledBlock(NodeId nodeFaster, NodeId nodeStaller, int64_t nTimeRequested, int64_t nNow)
+{
+    LOCK(cs_main);
+    return ShouldRerequestStalledBlock(State(nodeFaster), State(nodeStaller), nTimeRequested, nNow);
+}
+
 // Returns true for outbound peers, excluding manual connections, feelers, and
 // one-shots
 bool IsOutboundDisconnectionCandidate(const CNode *node)
@@ -614,6 +787,10 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlocksInFlightLimit = state->nBlocksInFlightLimit;
+    stats.nBlocksDownloaded = state->nBlocksDownloaded;
+    stats.nBlockDownloadLatency = state->nBlockDownloadLatency;
+    stats.nBlockDownloadRate = state->nBlockDownloadRate;
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -967,9 +1144,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+// Requires cs_main.
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
+    g_relay_batch.Queue(inv.hash, GetTimeMicros());
     connman->ForEachNode([&inv](CNode* pnode)
     {
         pnode->PushInventory(inv);
@@ -2565,6 +2744,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        const size_t nBlockSize = vRecv.size();
         vRecv >> *pblock;
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
@@ -2573,6 +2753,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            UpdateBlockDownloadStats(pfrom->GetId(), hash, nBlockSize);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3090,20 +3271,14 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
     }
 }
 
-class CompareInvMempoolOrder
+class CompareInvRelayOrder
 {
-    CTxMemPool *mp;
 public:
-    CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(const std::pair<size_t, std::set<uint256>::iterator>& a, const std::pair<size_t, std::set<uint256>::iterator>& b)
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+         * lowest rank in the shared relay order to sort later. */
+        return a.first > b.first;
     }
 };
 
@@ -3436,29 +3611,41 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CAmount filterrate = 0;
                 {
                     LOCK(pto->cs_feeFilter);
                     filterrate = pto->minFeeFilter;
                 }
-                // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
+                LOCK2(pto->cs_filter, mempool.cs);
+                // Produce a vector with all ranked candidates for sending. Unranked ones are
+                // queued to be ranked at the next rebuild; ones that left the mempool are dropped.
+                g_relay_batch.MaybeRebuild(mempool, nNow);
+                std::vector<std::pair<size_t, std::set<uint256>::iterator>> vInvTx;
+                vInvTx.reserve(pto->setInventoryTxToSend.size());
+                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); ) {
+                    size_t nRank = g_relay_batch.GetRank(*it);
+                    if (nRank == TxRelayBatch::GONE) {
+                        it = pto->setInventoryTxToSend.erase(it);
+                        continue;
+                    }
+                    if (nRank == TxRelayBatch::NO_RANK) {
+                        g_relay_batch.Queue(*it, nNow);
+                    } else {
+                        vInvTx.emplace_back(nRank, it);
+                    }
+                    it++;
+                }
+                // Send in the shared topological and fee-rate order, for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                CompareInvRelayOrder compareInvRelayOrder;
+                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
-                LOCK(pto->cs_filter);
                 while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
+                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvRelayOrder);
+                    std::set<uint256>::iterator it = vInvTx.back().second;
                     vInvTx.pop_back();
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
@@ -3568,10 +3755,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nBlocksInFlightLimit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            const CBlockIndex *pindexStalled = nullptr;
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalled, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -3579,6 +3767,22 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                 LogPrint(BCLog::NET, "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->GetId());
             }
+            if (staller != -1 && pindexStalled != nullptr) {
+                // The download window is blocked by a block in flight from another peer. If we are idle
+                // and a considerably faster source for it, move the request over before the staller
+                // times out.
+                std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(pindexStalled->GetBlockHash());
+                CNodeState *stateStaller = State(staller);
+                if (itInFlight != mapBlocksInFlight.end() && !itInFlight->second.second->partialBlock &&
+                        ShouldRerequestStalledBlock(&state, stateStaller, itInFlight->second.second->nTimeRequested, nNow)) {
+                    LogPrint(BCLog::NET, "Re-requesting stalled block %s (%d) from peer=%d instead of peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                        pindexStalled->nHeight, pto->GetId(), staller);
+                    stateStaller->nBlocksInFlightLimit = std::max(stateStaller->nBlocksInFlightLimit / 2, MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+                    vGetData.push_back(CInv(MSG_BLOCK | GetFetchFlags(pto), pindexStalled->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), pindexStalled);
+                    staller = -1;
+                }
+            }
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
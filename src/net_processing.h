@@ -73,6 +73,10 @@ struct CNodeStateStats {
     int nMisbehavior;
     int nSyncHeight;
     int nCommonHeight;
+    int nBlocksInFlightLimit;
+    int nBlocksDownloaded;
+    int64_t nBlockDownloadLatency;
+    int64_t nBlockDownloadRate;
     std::vector<int> vHeightInFlight;
 };
 
@@ -401,6 +401,11 @@ uint64_t CNetAddr::GetHash() const
     return nRet;
 }
 
+uint64_t CNetAddr::GetSaltedHash(uint64_t k0, uint64_t k1) const
+{
+    return CSipHasher(k0, k1).Write(ip, sizeof(ip)).Finalize();
+}
+
 // private extensions to enum Network, only returned by GetExtNetwork,
 // and only used in GetReachabilityFrom
 static const int NET_UNKNOWN = NET_MAX + 0;
@@ -75,8 +75,11 @@ class TxConfirmStats
 {
 private:
     //Define the buckets we will group transactions into
-    const std::vector<double>& buckets;              // The upper-bound of the range for the bucket (inclusive)
-    const std::map<double, unsigned int>& bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
+    std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
+
+    // All per-period statistics below are kept in flat arrays of
+    // periods * buckets.size() entries, indexed by Index(Y, X), so that
+    // updating or scanning them walks contiguous memory.
 
     // For each bucket X:
     // Count the total # of txs in each bucket
@@ -85,11 +88,11 @@ private:
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Index(Y, X)]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Index(Y, X)]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -103,13 +106,21 @@ private:
     // Resolution (# of blocks) with which confirmations are tracked
     unsigned int scale;
 
+    // Number of periods tracked in confAvg and failAvg
+    unsigned int periods;
+
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
-    std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    std::vector<int> unconfTxs;  //unconfTxs[Index(Y, X)]
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
+    size_t Index(unsigned int y, unsigned int bucketindex) const { return (size_t)y * buckets.size() + bucketindex; }
+
+    /** Find the bucket a feerate belongs to */
+    unsigned int BucketIndex(double val) const;
+
     void resizeInMemoryCounters(size_t newbuckets);
 
 public:
@@ -120,7 +131,7 @@ public:
      * @param maxPeriods max number of periods to track
      * @param decay how much to decay the historical moving average per block
      */
-    TxConfirmStats(const std::vector<double>& defaultBuckets, const std::map<double, unsigned int>& defaultBucketMap,
+    TxConfirmStats(const std::vector<double>& defaultBuckets,
                    unsigned int maxPeriods, double decay, unsigned int scale);
 
     /** Roll the circular buffer for unconfirmed txs*/
@@ -161,7 +172,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * periods; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -175,20 +186,14 @@ public:
 
 
 TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
-                                const std::map<double, unsigned int>& defaultBucketMap,
                                unsigned int maxPeriods, double _decay, unsigned int _scale)
-    : buckets(defaultBuckets), bucketMap(defaultBucketMap)
+    : buckets(defaultBuckets)
 {
     decay = _decay;
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    periods = maxPeriods;
+    confAvg.resize(periods * buckets.size());
+    failAvg.resize(periods * buckets.size());
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
@@ -196,21 +201,24 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     resizeInMemoryCounters(buckets.size());
 }
 
+unsigned int TxConfirmStats::BucketIndex(double val) const
+{
+    // The last bucket is INF_FEERATE, so every feerate has a bucket
+    return std::lower_bound(buckets.begin(), buckets.end(), val) - buckets.begin();
+}
+
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
-    // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
-    unconfTxs.resize(GetMaxConfirms());
-    for (unsigned int i = 0; i < unconfTxs.size(); i++) {
-        unconfTxs[i].resize(newbuckets);
-    }
-    oldUnconfTxs.resize(newbuckets);
+    unconfTxs.assign(GetMaxConfirms() * newbuckets, 0);
+    oldUnconfTxs.assign(newbuckets, 0);
 }
 
 // Roll the unconfirmed txs circular buffer
 void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
+    int* current = &unconfTxs[Index(nBlockHeight % GetMaxConfirms(), 0)];
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
+        oldUnconfTxs[j] += current[j];
+        current[j] = 0;
     }
 }
 
@@ -221,9 +229,9 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
-    unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    unsigned int bucketindex = BucketIndex(val);
+    for (size_t i = periodsToConfirm; i <= periods; i++) {
+        confAvg[Index(i - 1, bucketindex)]++;
     }
     txCtAvg[bucketindex]++;
     avg[bucketindex] += val;
@@ -231,11 +239,11 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 
 void TxConfirmStats::UpdateMovingAverages()
 {
+    for (double& val : confAvg)
+        val *= decay;
+    for (double& val : failAvg)
+        val *= decay;
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
         avg[j] = avg[j] * decay;
         txCtAvg[j] = txCtAvg[j] * decay;
     }
@@ -273,7 +281,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    unsigned int bins = GetMaxConfirms();
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -286,11 +294,11 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += confAvg[Index(periodTarget - 1, bucket)];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        failNum += failAvg[Index(periodTarget - 1, bucket)];
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+            extraNum += unconfTxs[Index((nBlockHeight - confct)%bins, bucket)];
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -394,22 +402,42 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
+// The estimates file stores per-period statistics as one vector per period
+static std::vector<std::vector<double>> UnflattenPeriods(const std::vector<double>& flat, unsigned int periods, size_t numBuckets)
+{
+    std::vector<std::vector<double>> ret(periods);
+    for (unsigned int i = 0; i < periods; i++) {
+        ret[i].assign(flat.begin() + i * numBuckets, flat.begin() + (i + 1) * numBuckets);
+    }
+    return ret;
+}
+
+static std::vector<double> FlattenPeriods(const std::vector<std::vector<double>>& periodAvgs)
+{
+    std::vector<double> ret;
+    for (const std::vector<double>& periodAvg : periodAvgs) {
+        ret.insert(ret.end(), periodAvg.begin(), periodAvg.end());
+    }
+    return ret;
+}
+
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
     fileout << scale;
     fileout << avg;
     fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << UnflattenPeriods(confAvg, periods, buckets.size());
+    fileout << UnflattenPeriods(failAvg, periods, buckets.size());
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
 {
     // Read data file and do some very basic sanity checking
-    // buckets and bucketMap are not updated yet, so don't access them
     // If there is a read failure, we'll just discard this entire object anyway
     size_t maxConfirms, maxPeriods;
+    std::vector<std::vector<double>> fileConfAvg;
+    std::vector<std::vector<double>> fileFailAvg;
 
     // The current version will store the decay with each individual TxConfirmStats and also keep a scale factor
     if (nFileVersion >= 149900) {
@@ -428,36 +456,40 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    filein >> fileConfAvg;
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
     if (nFileVersion >= 149900) {
-        filein >> failAvg;
-        if (maxPeriods != failAvg.size()) {
+        filein >> fileFailAvg;
+        if (maxPeriods != fileFailAvg.size()) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
         }
         for (unsigned int i = 0; i < maxPeriods; i++) {
-            if (failAvg[i].size() != numBuckets) {
+            if (fileFailAvg[i].size() != numBuckets) {
                 throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
             }
         }
     } else {
-        failAvg.resize(confAvg.size());
-        for (unsigned int i = 0; i < failAvg.size(); i++) {
-            failAvg[i].resize(numBuckets);
+        fileFailAvg.resize(maxPeriods);
+        for (unsigned int i = 0; i < maxPeriods; i++) {
+            fileFailAvg[i].resize(numBuckets);
         }
     }
 
+    periods = maxPeriods;
+    confAvg = FlattenPeriods(fileConfAvg);
+    failAvg = FlattenPeriods(fileFailAvg);
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -468,9 +500,9 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
 
 unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
 {
-    unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    unsigned int blockIndex = nBlockHeight % unconfTxs.size();
-    unconfTxs[blockIndex][bucketindex]++;
+    unsigned int bucketindex = BucketIndex(val);
+    unsigned int blockIndex = nBlockHeight % GetMaxConfirms();
+    unconfTxs[Index(blockIndex, bucketindex)]++;
     return bucketindex;
 }
 
@@ -485,7 +517,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
-    if (blocksAgo >= (int)unconfTxs.size()) {
+    if (blocksAgo >= (int)GetMaxConfirms()) {
         if (oldUnconfTxs[bucketindex] > 0) {
             oldUnconfTxs[bucketindex]--;
         } else {
@@ -494,9 +526,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         }
     }
     else {
-        unsigned int blockIndex = entryHeight % unconfTxs.size();
-        if (unconfTxs[blockIndex][bucketindex] > 0) {
-            unconfTxs[blockIndex][bucketindex]--;
+        unsigned int blockIndex = entryHeight % GetMaxConfirms();
+        if (unconfTxs[Index(blockIndex, bucketindex)] > 0) {
+            unconfTxs[Index(blockIndex, bucketindex)]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -505,11 +537,49 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+            failAvg[Index(i, bucketindex)]++;
         }
     }
 }
 
+struct CBlockPolicyEstimator::EstimatorSnapshot
+{
+    TxConfirmStats feeStats;
+    TxConfirmStats shortStats;
+    TxConfirmStats longStats;
+    unsigned int nBestSeenHeight;
+    unsigned int firstRecordedHeight;
+    unsigned int historicalFirst;
+    unsigned int historicalBest;
+
+    explicit EstimatorSnapshot(const CBlockPolicyEstimator& estimator)
+        : feeStats(*estimator.feeStats), shortStats(*estimator.shortStats), longStats(*estimator.longStats),
+          nBestSeenHeight(estimator.nBestSeenHeight), firstRecordedHeight(estimator.firstRecordedHeight),
+          historicalFirst(estimator.historicalFirst), historicalBest(estimator.historicalBest) {}
+
+    /** Helper for estimateSmartFee */
+    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
+    /** Helper for estimateSmartFee */
+    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+    /** Number of blocks of data recorded while fee estimates have been running */
+    unsigned int BlockSpan() const;
+    /** Number of blocks of recorded fee estimate data represented in saved data file */
+    unsigned int HistoricalBlockSpan() const;
+    /** Calculation of highest target that reasonable estimate can be provided for */
+    unsigned int MaxUsableEstimate() const;
+};
+
+void CBlockPolicyEstimator::PublishSnapshot()
+{
+    std::shared_ptr<const EstimatorSnapshot> newSnapshot = std::make_shared<const EstimatorSnapshot>(*this);
+    std::atomic_store(&snapshot, newSnapshot);
+}
+
+std::shared_ptr<const CBlockPolicyEstimator::EstimatorSnapshot> CBlockPolicyEstimator::GetSnapshot() const
+{
+    return std::atomic_load(&snapshot);
+}
+
 // This function is called from CTxMemPool::removeUnchecked to ensure
 // txs removed from the mempool for any reason are no longer
 // tracked. Txs that were part of a block have already been removed in
@@ -534,18 +604,16 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
-    size_t bucketIndex = 0;
-    for (double bucketBoundary = MIN_BUCKET_FEERATE; bucketBoundary <= MAX_BUCKET_FEERATE; bucketBoundary *= FEE_SPACING, bucketIndex++) {
+    for (double bucketBoundary = MIN_BUCKET_FEERATE; bucketBoundary <= MAX_BUCKET_FEERATE; bucketBoundary *= FEE_SPACING) {
         buckets.push_back(bucketBoundary);
-        bucketMap[bucketBoundary] = bucketIndex;
     }
     buckets.push_back(INF_FEERATE);
-    bucketMap[INF_FEERATE] = bucketIndex;
-    assert(bucketMap.size() == buckets.size());
 
-    feeStats = new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
-    shortStats = new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
-    longStats = new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE);
+    feeStats = new TxConfirmStats(buckets, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE);
+    shortStats = new TxConfirmStats(buckets, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE);
+    longStats = new TxConfirmStats(buckets, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE);
+
+    PublishSnapshot();
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -661,10 +729,12 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
         LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy first recorded height %u\n", firstRecordedHeight);
     }
 
+    PublishSnapshot();
+    std::shared_ptr<const EstimatorSnapshot> snap = GetSnapshot();
 
     LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy estimates updated by %u of %u block txs, since last block %u of %u tracked, mempool map size %u, max target %u from %s\n",
              countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size(),
-             MaxUsableEstimate(), HistoricalBlockSpan() > BlockSpan() ? "historical" : "current");
+             snap->MaxUsableEstimate(), snap->HistoricalBlockSpan() > snap->BlockSpan() ? "historical" : "current");
 
     trackedTxs = 0;
     untrackedTxs = 0;
@@ -681,20 +751,21 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
 
 CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult* result) const
 {
-    TxConfirmStats* stats;
+    std::shared_ptr<const EstimatorSnapshot> snap = GetSnapshot();
+    const TxConfirmStats* stats;
     double sufficientTxs = SUFFICIENT_FEETXS;
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        stats = shortStats;
+        stats = &snap->shortStats;
         sufficientTxs = SUFFICIENT_TXS_SHORT;
         break;
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        stats = feeStats;
+        stats = &snap->feeStats;
         break;
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        stats = longStats;
+        stats = &snap->longStats;
         break;
     }
     default: {
@@ -702,14 +773,13 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     }
     }
 
-    LOCK(cs_feeEstimator);
     // Return failure if trying to analyze a target we're not tracking
     if (confTarget <= 0 || (unsigned int)confTarget > stats->GetMaxConfirms())
         return CFeeRate(0);
     if (successThreshold > 1)
         return CFeeRate(0);
 
-    double median = stats->EstimateMedianVal(confTarget, sufficientTxs, successThreshold, true, nBestSeenHeight, result);
+    double median = stats->EstimateMedianVal(confTarget, sufficientTxs, successThreshold, true, snap->nBestSeenHeight, result);
 
     if (median < 0)
         return CFeeRate(0);
@@ -719,15 +789,16 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
+    std::shared_ptr<const EstimatorSnapshot> snap = GetSnapshot();
     switch (horizon) {
     case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        return shortStats->GetMaxConfirms();
+        return snap->shortStats.GetMaxConfirms();
     }
     case FeeEstimateHorizon::MED_HALFLIFE: {
-        return feeStats->GetMaxConfirms();
+        return snap->feeStats.GetMaxConfirms();
     }
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        return longStats->GetMaxConfirms();
+        return snap->longStats.GetMaxConfirms();
     }
     default: {
         throw std::out_of_range("CBlockPolicyEstimator::HighestTargetTracked unknown FeeEstimateHorizon");
@@ -735,7 +806,7 @@ unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon hori
     }
 }
 
-unsigned int CBlockPolicyEstimator::BlockSpan() const
+unsigned int CBlockPolicyEstimator::EstimatorSnapshot::BlockSpan() const
 {
     if (firstRecordedHeight == 0) return 0;
     assert(nBestSeenHeight >= firstRecordedHeight);
@@ -743,7 +814,7 @@ unsigned int CBlockPolicyEstimator::BlockSpan() const
     return nBestSeenHeight - firstRecordedHeight;
 }
 
-unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
+unsigned int CBlockPolicyEstimator::EstimatorSnapshot::HistoricalBlockSpan() const
 {
     if (historicalFirst == 0) return 0;
     assert(historicalBest >= historicalFirst);
@@ -753,42 +824,42 @@ unsigned int CBlockPolicyEstimator::HistoricalBlockSpan() const
     return historicalBest - historicalFirst;
 }
 
-unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
+unsigned int CBlockPolicyEstimator::EstimatorSnapshot::MaxUsableEstimate() const
 {
     // Block spans are divided by 2 to make sure there are enough potential failing data points for the estimate
-    return std::min(longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
+    return std::min(longStats.GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
 }
 
 /** Return a fee estimate at the required successThreshold from the shortest
  * time horizon which tracks confirmations up to the desired target.  If
  * checkShorterHorizon is requested, also allow short time horizon estimates
  * for a lower target to reduce the given answer */
-double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
+double CBlockPolicyEstimator::EstimatorSnapshot::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
 {
     double estimate = -1;
-    if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
+    if (confTarget >= 1 && confTarget <= longStats.GetMaxConfirms()) {
         // Find estimate from shortest time horizon possible
-        if (confTarget <= shortStats->GetMaxConfirms()) { // short horizon
-            estimate = shortStats->EstimateMedianVal(confTarget, SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, result);
+        if (confTarget <= shortStats.GetMaxConfirms()) { // short horizon
+            estimate = shortStats.EstimateMedianVal(confTarget, SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, result);
         }
-        else if (confTarget <= feeStats->GetMaxConfirms()) { // medium horizon
-            estimate = feeStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
+        else if (confTarget <= feeStats.GetMaxConfirms()) { // medium horizon
+            estimate = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
         }
         else { // long horizon
-            estimate = longStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
+            estimate = longStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, result);
         }
         if (checkShorterHorizon) {
             EstimationResult tempResult;
             // If a lower confTarget from a more recent horizon returns a lower answer use it.
-            if (confTarget > feeStats->GetMaxConfirms()) {
-                double medMax = feeStats->EstimateMedianVal(feeStats->GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, &tempResult);
+            if (confTarget > feeStats.GetMaxConfirms()) {
+                double medMax = feeStats.EstimateMedianVal(feeStats.GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, true, nBestSeenHeight, &tempResult);
                 if (medMax > 0 && (estimate == -1 || medMax < estimate)) {
                     estimate = medMax;
                     if (result) *result = tempResult;
                 }
             }
-            if (confTarget > shortStats->GetMaxConfirms()) {
-                double shortMax = shortStats->EstimateMedianVal(shortStats->GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, &tempResult);
+            if (confTarget > shortStats.GetMaxConfirms()) {
+                double shortMax = shortStats.EstimateMedianVal(shortStats.GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, true, nBestSeenHeight, &tempResult);
                 if (shortMax > 0 && (estimate == -1 || shortMax < estimate)) {
                     estimate = shortMax;
                     if (result) *result = tempResult;
@@ -802,15 +873,15 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
 /** Ensure that for a conservative estimate, the DOUBLE_SUCCESS_PCT is also met
  * at 2 * target for any longer time horizons.
  */
-double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
+double CBlockPolicyEstimator::EstimatorSnapshot::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
 {
     double estimate = -1;
     EstimationResult tempResult;
-    if (doubleTarget <= shortStats->GetMaxConfirms()) {
-        estimate = feeStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, result);
+    if (doubleTarget <= shortStats.GetMaxConfirms()) {
+        estimate = feeStats.EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, result);
     }
-    if (doubleTarget <= feeStats->GetMaxConfirms()) {
-        double longEstimate = longStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
+    if (doubleTarget <= feeStats.GetMaxConfirms()) {
+        double longEstimate = longStats.EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight, &tempResult);
         if (longEstimate > estimate) {
             estimate = longEstimate;
             if (result) *result = tempResult;
@@ -828,7 +899,7 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(cs_feeEstimator);
+    std::shared_ptr<const EstimatorSnapshot> snap = GetSnapshot();
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
@@ -839,14 +910,14 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     EstimationResult tempResult;
 
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+    if (confTarget <= 0 || (unsigned int)confTarget > snap->longStats.GetMaxConfirms()) {
         return CFeeRate(0);  // error condition
     }
 
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1) confTarget = 2;
 
-    unsigned int maxUsableEstimate = MaxUsableEstimate();
+    unsigned int maxUsableEstimate = snap->MaxUsableEstimate();
     if ((unsigned int)confTarget > maxUsableEstimate) {
         confTarget = maxUsableEstimate;
     }
@@ -865,13 +936,13 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * the purpose of conservative estimates is not to let short term
      * fluctuations lower our estimates by too much.
      */
-    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
+    double halfEst = snap->estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
     if (feeCalc) {
         feeCalc->est = tempResult;
         feeCalc->reason = FeeReason::HALF_ESTIMATE;
     }
     median = halfEst;
-    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
+    double actualEst = snap->estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
         if (feeCalc) {
@@ -879,7 +950,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
             feeCalc->reason = FeeReason::FULL_ESTIMATE;
         }
     }
-    double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
+    double doubleEst = snap->estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
         if (feeCalc) {
@@ -889,7 +960,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     }
 
     if (conservative || median == -1) {
-        double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
+        double consEst =  snap->estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
             if (feeCalc) {
@@ -912,7 +983,8 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
         fileout << 149900; // version required to read: 0.14.99 or later
         fileout << CLIENT_VERSION; // version that wrote the file
         fileout << nBestSeenHeight;
-        if (BlockSpan() > HistoricalBlockSpan()/2) {
+        std::shared_ptr<const EstimatorSnapshot> snap = GetSnapshot();
+        if (snap->BlockSpan() > snap->HistoricalBlockSpan()/2) {
             fileout << firstRecordedHeight << nBestSeenHeight;
         }
         else {
@@ -958,16 +1030,9 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             if (tempNum <= 1 || tempNum > 1000)
                 throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
 
-            std::map<double, unsigned int> tempMap;
-
-            std::unique_ptr<TxConfirmStats> tempFeeStats(new TxConfirmStats(tempBuckets, tempMap, MED_BLOCK_PERIODS, tempDecay, 1));
+            std::unique_ptr<TxConfirmStats> tempFeeStats(new TxConfirmStats(tempBuckets, MED_BLOCK_PERIODS, tempDecay, 1));
             tempFeeStats->Read(filein, nVersionThatWrote, tempNum);
             // if nVersionThatWrote < 139900 then another TxConfirmStats (for priority) follows but can be ignored.
-
-            tempMap.clear();
-            for (unsigned int i = 0; i < tempBuckets.size(); i++) {
-                tempMap[tempBuckets[i]] = i;
-            }
         }
         else { // nVersionThatWrote >= 149900
             unsigned int nFileHistoricalFirst, nFileHistoricalBest;
@@ -981,22 +1046,18 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             if (numBuckets <= 1 || numBuckets > 1000)
                 throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 feerate buckets");
 
-            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
-            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
-            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+            std::unique_ptr<TxConfirmStats> fileFeeStats(new TxConfirmStats(fileBuckets, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
+            std::unique_ptr<TxConfirmStats> fileShortStats(new TxConfirmStats(fileBuckets, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
+            std::unique_ptr<TxConfirmStats> fileLongStats(new TxConfirmStats(fileBuckets, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
             fileFeeStats->Read(filein, nVersionThatWrote, numBuckets);
             fileShortStats->Read(filein, nVersionThatWrote, numBuckets);
             fileLongStats->Read(filein, nVersionThatWrote, numBuckets);
 
             // Fee estimates file parsed correctly
-            // Copy buckets from file and refresh our bucketmap
+            // Copy buckets from file
             buckets = fileBuckets;
-            bucketMap.clear();
-            for (unsigned int i = 0; i < buckets.size(); i++) {
-                bucketMap[buckets[i]] = i;
-            }
 
-            // Destroy old TxConfirmStats and point to new ones that already reference buckets and bucketMap
+            // Destroy old TxConfirmStats and point to new ones that already use the file's buckets
             delete feeStats;
             delete shortStats;
             delete longStats;
@@ -1007,6 +1068,8 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+
+            PublishSnapshot();
         }
     }
     catch (const std::exception& e) {
@@ -12,6 +12,7 @@
 #include "sync.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -253,23 +254,21 @@ private:
     unsigned int untrackedTxs;
 
     std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
-    std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** Copy of the statistics and heights that estimates are calculated from */
+    struct EstimatorSnapshot;
+    /** Republished after every block, so that estimates are served without
+     *  taking cs_feeEstimator. Only accessed through std::atomic_load/store. */
+    std::shared_ptr<const EstimatorSnapshot> snapshot;
+
+    /** Copy the current statistics into a new snapshot (cs_feeEstimator must be held) */
+    void PublishSnapshot();
+    std::shared_ptr<const EstimatorSnapshot> GetSnapshot() const;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
-
-    /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
-    /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
-    /** Number of blocks of data recorded while fee estimates have been running */
-    unsigned int BlockSpan() const;
-    /** Number of blocks of recorded fee estimate data represented in saved data file */
-    unsigned int HistoricalBlockSpan() const;
-    /** Calculation of highest target that reasonable estimate can be provided for */
-    unsigned int MaxUsableEstimate() const;
 };
 
 class FeeFilterRounder
@@ -158,7 +158,7 @@ uint256 ComputeStakeModifierV2(const CBlockIndex* pindexPrev, const uint256& ker
     return Hash(ss.begin(), ss.end());
 }
 
-bool IsCanonicalBlockSignature(const CBlock& block)
+bool IsCanonicalBlockSignature(const CBlockHeader& block)
 {
     if (block.IsProofOfWork()) {
         return block.vchBlockSig.empty();
@@ -290,13 +290,12 @@ bool CheckStakeKernelHash(uint256 bnStakeModifierV2, int nPrevHeight, uint32_t n
 }
 
 bool CheckProofOfStake(CCoinsViewCache* view, uint256 bnStakeModifierV2, int nPrevHeight, uint32_t nBits, uint32_t nTime, const COutPoint& prevout) {
-    if (!view->HaveCoin(prevout)) {
+    const Coin& coin = view->AccessCoin(prevout);
+    if (coin.IsSpent()) {
         LogPrint(BCLog::STAKE, "%s: inputs missing/spent\n", __func__);
         return false;
     }
 
-    auto coin = view->AccessCoin(prevout);
-
     if (nPrevHeight + 1 - coin.nHeight < COINBASE_MATURITY) {
         LogPrint(BCLog::STAKE, "%s: tried to stake at depth %d\n", __func__, nPrevHeight + 1 - coin.nHeight);
         return false;
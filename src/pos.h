@@ -52,7 +52,7 @@ bool CreatePoSBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet);
 /** Generate a new block, without valid proof-of-work */
 void StakeB2X(bool fStake, CWallet *pwallet);
 
-bool IsCanonicalBlockSignature(const CBlock& block);
+bool IsCanonicalBlockSignature(const CBlockHeader& block);
 bool CheckBlockSignature(const CBlock& block);
 
 uint256 ComputeStakeModifierV2(const CBlockIndex* pindexPrev, const uint256& kernel);
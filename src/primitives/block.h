@@ -69,7 +69,7 @@ public:
         return (nBits == 0);
     }
 
-    uint256 GetHash() const;
+    virtual uint256 GetHash() const;
 
     int64_t GetBlockTime() const
     {
@@ -108,6 +108,7 @@ public:
 
     // memory only
     mutable bool fChecked;
+    mutable uint256 hashChecked;
 
     CBlock()
     {
@@ -133,6 +134,13 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        hashChecked.SetNull();
+    }
+
+    // A block that passed CheckBlock keeps the header hash computed there
+    uint256 GetHash() const override
+    {
+        return fChecked ? hashChecked : CBlockHeader::GetHash();
     }
 
     // ppcoin: two types of block: proof-of-work or proof-of-stake
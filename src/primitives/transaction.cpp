@@ -67,18 +67,57 @@ uint256 CTransaction::ComputeHash() const
     return SerializeHash(*this, SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS);
 }
 
-uint256 CTransaction::GetWitnessHash() const
+uint256 CTransaction::ComputeWitnessHash() const
 {
     if (!HasWitness()) {
-        return GetHash();
+        return hash;
     }
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+uint32_t CTransaction::ComputeSize(int nVersionIn) const
+{
+    CSizeComputer s(SER_NETWORK, nVersionIn);
+    SerializeTransaction(*this, s);
+    return s.size();
+}
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), nLockTime(0), hash(), m_witness_hash(), nStrippedSize(ComputeSize(SERIALIZE_TRANSACTION_NO_WITNESS)), nTotalSize(nStrippedSize) {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), hash(ComputeHash()), m_witness_hash(ComputeWitnessHash()), nStrippedSize(ComputeSize(PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)), nTotalSize(ComputeSize(PROTOCOL_VERSION)) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), hash(ComputeHash()), m_witness_hash(ComputeWitnessHash()), nStrippedSize(ComputeSize(PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)), nTotalSize(ComputeSize(PROTOCOL_VERSION)) {}
+CTransaction::CTransaction(Wire&& wire) : nVersion(wire.tx.nVersion), vin(std::move(wire.tx.vin)), vout(std::move(wire.tx.vout)), nLockTime(wire.tx.nLockTime), hash(wire.hash), m_witness_hash(wire.witnessHash), nStrippedSize(wire.nStrippedSize), nTotalSize(wire.nTotalSize) {}
+
+void CTransaction::Wire::ComputeHashes(const std::vector<unsigned char>& vchRaw, bool fAllowWitness)
+{
+    // The extended format has a zero dummy vin count followed by non-zero
+    // flags; an empty vin followed by an empty vout is the basic format.
+    const bool fExtended = fAllowWitness && vchRaw.size() > 5 && vchRaw[4] == 0 && vchRaw[5] != 0;
+    size_t nWitnessSize = 0;
+    if (fExtended) {
+        for (const auto& txin : tx.vin) {
+            nWitnessSize += ::GetSerializeSize(txin.scriptWitness.stack, SER_NETWORK, PROTOCOL_VERSION);
+        }
+    }
+    nStrippedSize = fExtended ? vchRaw.size() - 2 - nWitnessSize : vchRaw.size();
+
+    // The txid skips the dummy, the flags and the witnesses.
+    if (fExtended) {
+        CHash256().Write(vchRaw.data(), 4).Write(vchRaw.data() + 6, nStrippedSize - 8).Write(vchRaw.data() + vchRaw.size() - 4, 4).Finalize(hash.begin());
+    } else {
+        CHash256().Write(vchRaw.data(), vchRaw.size()).Finalize(hash.begin());
+    }
+
+    // An extended encoding whose witnesses are all empty serializes back in
+    // the basic format, so its wtxid and total size are the stripped ones.
+    if (tx.HasWitness()) {
+        CHash256().Write(vchRaw.data(), vchRaw.size()).Finalize(witnessHash.begin());
+        nTotalSize = vchRaw.size();
+    } else {
+        witnessHash = hash;
+        nTotalSize = nStrippedSize;
+    }
+}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -93,7 +132,7 @@ CAmount CTransaction::GetValueOut() const
 
 unsigned int CTransaction::GetTotalSize() const
 {
-    return ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+    return nTotalSize;
 }
 
 std::string CTransaction::ToString() const
@@ -258,6 +258,38 @@ inline void SerializeTransaction(const TxType& tx, Stream& s) {
 }
 
 
+/**
+ * Stream wrapper that keeps a copy of every byte read through it, so that a
+ * transaction can be hashed and sized from its wire encoding rather than by
+ * serializing it again.
+ */
+template<typename Stream>
+class CTxRecordingStream
+{
+private:
+    Stream& stream;
+    std::vector<unsigned char>& vchRaw;
+
+public:
+    CTxRecordingStream(Stream& streamIn, std::vector<unsigned char>& vchRawIn) : stream(streamIn), vchRaw(vchRawIn) {}
+
+    int GetType() const { return stream.GetType(); }
+    int GetVersion() const { return stream.GetVersion(); }
+
+    void read(char* pch, size_t nSize)
+    {
+        stream.read(pch, nSize);
+        vchRaw.insert(vchRaw.end(), (const unsigned char*)pch, (const unsigned char*)pch + nSize);
+    }
+
+    template<typename T>
+    CTxRecordingStream& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj);
+        return *this;
+    }
+};
+
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
  */
@@ -286,8 +318,18 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    const uint256 m_witness_hash;
+    /** Serialized sizes without and with witness data. Memory only. */
+    const uint32_t nStrippedSize;
+    const uint32_t nTotalSize;
 
     uint256 ComputeHash() const;
+    uint256 ComputeWitnessHash() const;
+    uint32_t ComputeSize(int nVersionIn) const;
+
+    /** A transaction as read off the wire, with its hashes and sizes. */
+    struct Wire;
+    explicit CTransaction(Wire&& wire);
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -302,10 +344,16 @@ public:
         SerializeTransaction(*this, s);
     }
 
+    /** Both serialized sizes are cached, so computing one is free. */
+    void Serialize(CSizeComputer& s) const {
+        s.seek((s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS) ? nStrippedSize : nTotalSize);
+    }
+
     /** This deserializing constructor is provided instead of an Unserialize method.
-     *  Unserialize is not possible, since it would require overwriting const fields. */
+     *  Unserialize is not possible, since it would require overwriting const fields.
+     *  The txid, wtxid and sizes are computed over the bytes as read. */
     template <typename Stream>
-    CTransaction(deserialize_type, Stream& s) : CTransaction(CMutableTransaction(deserialize, s)) {}
+    CTransaction(deserialize_type, Stream& s) : CTransaction(Wire(deserialize, s)) {}
 
     bool IsNull() const {
         return vin.empty() && vout.empty();
@@ -315,8 +363,10 @@ public:
         return hash;
     }
 
-    // Compute a hash that includes both transaction and witness data
-    uint256 GetWitnessHash() const;
+    // Hash that includes both transaction and witness data
+    const uint256& GetWitnessHash() const {
+        return m_witness_hash;
+    }
 
     // Return sum of txouts.
     CAmount GetValueOut() const;
@@ -412,6 +462,27 @@ struct CMutableTransaction
     }
 };
 
+struct CTransaction::Wire
+{
+    CMutableTransaction tx;
+    uint256 hash;
+    uint256 witnessHash;
+    uint32_t nStrippedSize;
+    uint32_t nTotalSize;
+
+    template <typename Stream>
+    Wire(deserialize_type, Stream& s)
+    {
+        std::vector<unsigned char> vchRaw;
+        vchRaw.reserve(256);
+        CTxRecordingStream<Stream> rs(s, vchRaw);
+        UnserializeTransaction(tx, rs);
+        ComputeHashes(vchRaw, !(s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS));
+    }
+
+    void ComputeHashes(const std::vector<unsigned char>& vchRaw, bool fAllowWitness);
+};
+
 typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
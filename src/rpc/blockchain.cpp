@@ -361,27 +361,25 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+static void entryToJSON(UniValue &info, const TxMempoolEntrySnapshot &e)
 {
-    AssertLockHeld(mempool.cs);
-
-    info.push_back(Pair("size", (int)e.GetTxSize()));
-    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-    info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-    info.push_back(Pair("time", e.GetTime()));
-    info.push_back(Pair("height", (int)e.GetHeight()));
-    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-    info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-    info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
-    info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
-    info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    const CTransaction& tx = e.GetTx();
+    info.push_back(Pair("size", (int)e.nTxSize));
+    info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+    info.push_back(Pair("modifiedfee", ValueFromAmount(e.nModFee)));
+    info.push_back(Pair("time", e.nTime));
+    info.push_back(Pair("height", (int)e.nHeight));
+    info.push_back(Pair("descendantcount", e.nCountWithDescendants));
+    info.push_back(Pair("descendantsize", e.nSizeWithDescendants));
+    info.push_back(Pair("descendantfees", e.nModFeesWithDescendants));
+    info.push_back(Pair("ancestorcount", e.nCountWithAncestors));
+    info.push_back(Pair("ancestorsize", e.nSizeWithAncestors));
+    info.push_back(Pair("ancestorfees", e.nModFeesWithAncestors));
+
+    // setDepends is ordered by hash, not by hex string
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& dep : e.setDepends)
     {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(dep.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -393,15 +391,23 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     info.push_back(Pair("depends", depends));
 }
 
+void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+{
+    AssertLockHeld(mempool.cs);
+    entryToJSON(info, mempool.GetEntrySnapshot(e));
+}
+
 UniValue mempoolToJSON(bool fVerbose)
 {
     if (fVerbose)
     {
-        LOCK(mempool.cs);
+        // Build the result from a snapshot, so that mempool.cs is not held
+        // while formatting a possibly very large reply
+        std::shared_ptr<const TxMempoolSnapshot> snapshot = mempool.GetSnapshot();
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        for (const TxMempoolEntrySnapshot& e : snapshot->vEntries)
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = e.txid;
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.push_back(Pair(hash.ToString(), info));
@@ -95,8 +95,9 @@ UniValue getinfo(const JSONRPCRequest& request)
 #ifdef ENABLE_WALLET
     if (pwallet) {
         obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-        obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
-        obj.push_back(Pair("stake",         ValueFromAmount(pwallet->GetStake())));
+        const WalletBalances balances = pwallet->GetBalances();
+        obj.push_back(Pair("balance",       ValueFromAmount(balances.nTrusted)));
+        obj.push_back(Pair("stake",         ValueFromAmount(balances.nStake)));
     }
 #endif
     obj.push_back(Pair("blocks",        (int)chainActive.Height()));
@@ -65,6 +65,27 @@ UniValue ping(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue BytesPerMsgCmdToJSON(const mapMsgCmdSize& mapBytes)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const mapMsgCmdSize::value_type &i : mapBytes) {
+        if (i.second > 0)
+            ret.push_back(Pair(i.first, i.second));
+    }
+    return ret;
+}
+
+static UniValue SendTimePerMsgCmdToJSON(const mapMsgCmdSize& mapCount, const mapMsgCmdSize& mapTime)
+{
+    UniValue ret(UniValue::VOBJ);
+    for (const mapMsgCmdSize::value_type &i : mapCount) {
+        mapMsgCmdSize::const_iterator it = mapTime.find(i.first);
+        if (i.second > 0 && it != mapTime.end())
+            ret.push_back(Pair(i.first, ((double)it->second) / i.second / 1e6));
+    }
+    return ret;
+}
+
 UniValue getpeerinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -101,6 +122,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) The current adaptive limit on blocks in flight from this peer\n"
+            "    \"blocksdownloaded\": n,     (numeric) The number of requested blocks received from this peer\n"
+            "    \"blockdownloadtime\": n,    (numeric) Average time between requesting and receiving a block, in seconds (if available)\n"
+            "    \"blockdownloadrate\": n,    (numeric) Average block download rate, in bytes per second (if available)\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
@@ -109,6 +134,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "    \"bytesrecv_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"sendtime_per_msg\": {\n"
+            "       \"addr\": n,              (numeric) The average time in seconds between queueing and fully sending a message, by message type\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -167,22 +196,18 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("inflight_limit", statestats.nBlocksInFlightLimit));
+            obj.push_back(Pair("blocksdownloaded", statestats.nBlocksDownloaded));
+            if (statestats.nBlocksDownloaded > 0) {
+                obj.push_back(Pair("blockdownloadtime", ((double)statestats.nBlockDownloadLatency) / 1e6));
+                obj.push_back(Pair("blockdownloadrate", statestats.nBlockDownloadRate));
+            }
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
 
-        UniValue sendPerMsgCmd(UniValue::VOBJ);
-        for (const mapMsgCmdSize::value_type &i : stats.mapSendBytesPerMsgCmd) {
-            if (i.second > 0)
-                sendPerMsgCmd.push_back(Pair(i.first, i.second));
-        }
-        obj.push_back(Pair("bytessent_per_msg", sendPerMsgCmd));
-
-        UniValue recvPerMsgCmd(UniValue::VOBJ);
-        for (const mapMsgCmdSize::value_type &i : stats.mapRecvBytesPerMsgCmd) {
-            if (i.second > 0)
-                recvPerMsgCmd.push_back(Pair(i.first, i.second));
-        }
-        obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
+        obj.push_back(Pair("bytessent_per_msg", BytesPerMsgCmdToJSON(stats.mapSendBytesPerMsgCmd)));
+        obj.push_back(Pair("bytesrecv_per_msg", BytesPerMsgCmdToJSON(stats.mapRecvBytesPerMsgCmd)));
+        obj.push_back(Pair("sendtime_per_msg", SendTimePerMsgCmdToJSON(stats.mapSendCountPerMsgCmd, stats.mapSendTimePerMsgCmd)));
 
         ret.push_back(obj);
     }
@@ -365,6 +390,18 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"bytessent_per_msg\": {\n"
+            "     \"addr\": n,             (numeric) The total bytes sent to all peers aggregated by message type\n"
+            "     ...\n"
+            "  },\n"
+            "  \"bytesrecv_per_msg\": {\n"
+            "     \"addr\": n,             (numeric) The total bytes received from all peers aggregated by message type\n"
+            "     ...\n"
+            "  },\n"
+            "  \"sendtime_per_msg\": {\n"
+            "     \"addr\": n,             (numeric) The average time in seconds between queueing and fully sending a message, by message type\n"
+            "     ...\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -387,6 +424,13 @@ UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.push_back(Pair("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft()));
     outboundLimit.push_back(Pair("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle()));
     obj.push_back(Pair("uploadtarget", outboundLimit));
+
+    mapMsgCmdSize mapRecvBytes, mapSendBytes, mapSendCount, mapSendTime;
+    g_connman->GetTotalBytesPerMsgCmd(mapRecvBytes, mapSendBytes);
+    g_connman->GetTotalSendTimePerMsgCmd(mapSendCount, mapSendTime);
+    obj.push_back(Pair("bytessent_per_msg", BytesPerMsgCmdToJSON(mapSendBytes)));
+    obj.push_back(Pair("bytesrecv_per_msg", BytesPerMsgCmdToJSON(mapRecvBytes)));
+    obj.push_back(Pair("sendtime_per_msg", SendTimePerMsgCmdToJSON(mapSendCount, mapSendTime)));
     return obj;
 }
 
@@ -1075,6 +1075,87 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawpackage(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawpackage [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits a package of raw transactions (serialized, hex-encoded) to local node and network.\n"
+            "The transactions must be sorted so that parents come before their children. The mempool\n"
+            "minimum fee and minimum relay fee are checked against the feerate of the package as a whole,\n"
+            "so a child can pay for a parent that would not be accepted on its own. Either all transactions\n"
+            "are accepted or none are.\n"
+            "\nArguments:\n"
+            "1. [\"hexstring\",...]  (array, required) The hex strings of the raw transactions, at most " + std::to_string(MAX_PACKAGE_COUNT) + "\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array of strings)\n"
+            "  \"hex\"           (string) The transaction hashes in hex\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawpackage", "\"[\\\"signedparenthex\\\",\\\"signedchildhex\\\"]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendrawpackage", "[\"signedparenthex\",\"signedchildhex\"]")
+        );
+
+    LOCK(cs_main);
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexstrings = request.params[0].get_array();
+    if (hexstrings.size() == 0 || hexstrings.size() > MAX_PACKAGE_COUNT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Package must contain between 1 and %u transactions", MAX_PACKAGE_COUNT));
+
+    std::vector<CTransactionRef> package;
+    for (unsigned int idx = 0; idx < hexstrings.size(); idx++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, hexstrings[idx].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", idx));
+        package.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (request.params.size() > 1 && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    CCoinsViewCache &view = *pcoinsTip;
+    for (const CTransactionRef& tx : package) {
+        for (size_t o = 0; o < tx->vout.size(); o++) {
+            if (!view.AccessCoin(COutPoint(tx->GetHash(), o)).IsSpent())
+                throw JSONRPCError(RPC_TRANSACTION_ALREADY_IN_CHAIN, strprintf("transaction %s already in block chain", tx->GetHash().GetHex()));
+        }
+    }
+
+    // push to local node and sync with wallets
+    CValidationState state;
+    bool fMissingInputs;
+    uint256 hashFailed;
+    if (!AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs, nMaxRawTxFee, &hashFailed)) {
+        std::string strFailed = hashFailed.IsNull() ? "package" : hashFailed.GetHex();
+        if (state.IsInvalid()) {
+            throw JSONRPCError(RPC_TRANSACTION_REJECTED, strprintf("%s: %i: %s", strFailed, state.GetRejectCode(), state.GetRejectReason()));
+        } else {
+            if (fMissingInputs) {
+                throw JSONRPCError(RPC_TRANSACTION_ERROR, strprintf("%s: Missing inputs", strFailed));
+            }
+            throw JSONRPCError(RPC_TRANSACTION_ERROR, strprintf("%s: %s", strFailed, state.GetRejectReason()));
+        }
+    }
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue result(UniValue::VARR);
+    for (const CTransactionRef& tx : package) {
+        CInv inv(MSG_TX, tx->GetHash());
+        g_connman->ForEachNode([&inv](CNode* pnode)
+        {
+            pnode->PushInventory(inv);
+        });
+        result.push_back(tx->GetHash().GetHex());
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1083,6 +1164,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  {"hexstring"} },
     { "rawtransactions",    "decodescript",           &decodescript,           true,  {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false, {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawpackage",         &sendrawpackage,         false, {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  true,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false, {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
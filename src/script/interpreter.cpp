@@ -11,8 +11,11 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
+#include <algorithm>
+
 namespace {
 
 inline bool set_success(ScriptError* ret)
@@ -1164,6 +1167,11 @@ public:
     }
 };
 
+/** Serialized size of a COutPoint */
+const size_t LEGACY_PREVOUT_SIZE = 36;
+/** Serialized size of an input with its scriptSig blanked out */
+const size_t LEGACY_INPUT_SIZE = LEGACY_PREVOUT_SIZE + 1 + sizeof(uint32_t);
+
 uint256 GetPrevoutHash(const CTransaction& txTo) {
     CHashWriter ss(SER_GETHASH, 0);
     for (const auto& txin : txTo.vin) {
@@ -1190,16 +1198,92 @@ uint256 GetOutputsHash(const CTransaction& txTo) {
 
 } // namespace
 
-PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo) : state(EMPTY), legacyState(EMPTY)
+{
+    Ready(txTo);
+}
+
+PrecomputedTransactionData::PrecomputedTransactionData() : state(EMPTY), legacyState(EMPTY) {}
+
+PrecomputedTransactionData::PrecomputedTransactionData(const PrecomputedTransactionData& other) :
+    hashPrevouts(other.hashPrevouts), hashSequence(other.hashSequence), hashOutputs(other.hashOutputs),
+    state(other.state.load() == READY ? READY : EMPTY), legacyState(EMPTY)
 {
+    if (other.legacyState.load(std::memory_order_acquire) == READY) {
+        legacyInputs = other.legacyInputs;
+        legacyTail = other.legacyTail;
+        legacyMidstates.reserve(other.legacyMidstates.size());
+        for (const CHashWriter& midstate : other.legacyMidstates) {
+            legacyMidstates.push_back(midstate);
+        }
+        legacyState.store(READY, std::memory_order_release);
+    }
+}
+
+const PrecomputedTransactionData* PrecomputedTransactionData::Ready(const CTransaction& txTo) const
+{
+    int expected = state.load(std::memory_order_acquire);
+    if (expected == READY) {
+        return this;
+    }
+    if (expected != EMPTY || !state.compare_exchange_strong(expected, FILLING, std::memory_order_acquire)) {
+        return nullptr;
+    }
     hashPrevouts = GetPrevoutHash(txTo);
     hashSequence = GetSequenceHash(txTo);
     hashOutputs = GetOutputsHash(txTo);
+    state.store(READY, std::memory_order_release);
+    return this;
+}
+
+const PrecomputedTransactionData* PrecomputedTransactionData::ReadyLegacy(const CTransaction& txTo) const
+{
+    if (txTo.vin.size() < 2) {
+        return nullptr;
+    }
+    int expected = legacyState.load(std::memory_order_acquire);
+    if (expected == READY) {
+        return this;
+    }
+    if (expected != EMPTY || !legacyState.compare_exchange_strong(expected, FILLING, std::memory_order_acquire)) {
+        return nullptr;
+    }
+
+    // Every input other than the one being signed serializes as its prevout,
+    // an empty script and its nSequence, so all of them have the same size.
+    legacyInputs.clear();
+    legacyInputs.reserve(txTo.vin.size() * LEGACY_INPUT_SIZE);
+    CVectorWriter inputs(SER_GETHASH, 0, legacyInputs, 0);
+    for (const auto& txin : txTo.vin) {
+        inputs << txin.prevout << CScript() << txin.nSequence;
+    }
+    assert(legacyInputs.size() == txTo.vin.size() * LEGACY_INPUT_SIZE);
+
+    legacyTail.clear();
+    CVectorWriter tail(SER_GETHASH, 0, legacyTail, 0);
+    tail << txTo.vout << txTo.nLockTime;
+
+    legacyMidstates.clear();
+    legacyMidstates.reserve(txTo.vin.size() / LEGACY_MIDSTATE_INTERVAL + 1);
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.nVersion;
+    WriteCompactSize(ss, txTo.vin.size());
+    for (unsigned int i = 0; i < txTo.vin.size(); i += LEGACY_MIDSTATE_INTERVAL) {
+        legacyMidstates.push_back(ss);
+        unsigned int nCount = std::min<size_t>(LEGACY_MIDSTATE_INTERVAL, txTo.vin.size() - i);
+        ss.write((const char*)&legacyInputs[i * LEGACY_INPUT_SIZE], nCount * LEGACY_INPUT_SIZE);
+    }
+
+    legacyState.store(READY, std::memory_order_release);
+    return this;
 }
 
 uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
 {
     if (sigversion == SIGVERSION_WITNESS_V0) {
+        if (cache) {
+            cache = cache->Ready(txTo);
+        }
         uint256 hashPrevouts;
         uint256 hashSequence;
         uint256 hashOutputs;
@@ -1261,6 +1345,33 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL only differs between inputs in which one carries the
+    // scriptCode, so resume from the cached serialization when there is one.
+    if (cache && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x0f) != SIGHASH_SINGLE && (nHashType & 0x0f) != SIGHASH_NONE) {
+        cache = cache->ReadyLegacy(txTo);
+    } else {
+        cache = nullptr;
+    }
+    if (cache) {
+        const unsigned int nMidstate = nIn / PrecomputedTransactionData::LEGACY_MIDSTATE_INTERVAL;
+        const unsigned int nFirst = nMidstate * PrecomputedTransactionData::LEGACY_MIDSTATE_INTERVAL;
+        const char* pInputs = (const char*)cache->legacyInputs.data();
+        const char* pIn = pInputs + nIn * LEGACY_INPUT_SIZE;
+
+        CHashWriter ss(cache->legacyMidstates[nMidstate]);
+        // Blanked inputs between the midstate and the one being signed
+        ss.write(pInputs + nFirst * LEGACY_INPUT_SIZE, (nIn - nFirst) * LEGACY_INPUT_SIZE);
+        // The input being signed: prevout, scriptCode, nSequence
+        ss.write(pIn, LEGACY_PREVOUT_SIZE);
+        txTmp.SerializeScriptCode(ss);
+        ss.write(pIn + LEGACY_INPUT_SIZE - sizeof(uint32_t), sizeof(uint32_t));
+        // Remaining blanked inputs, outputs and nLockTime
+        ss.write(pIn + LEGACY_INPUT_SIZE, (txTo.vin.size() - nIn - 1) * LEGACY_INPUT_SIZE);
+        ss.write((const char*)cache->legacyTail.data(), cache->legacyTail.size());
+        ss << (nHashType & SIGHASH_FORKID_SHIFT ? (nHashType << 1) : nHashType);
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << (nHashType & SIGHASH_FORKID_SHIFT ? (nHashType << 1) : nHashType);
@@ -1426,7 +1537,185 @@ static bool VerifyWitnessProgram(const CScriptWitness& witness, int witversion,
     return true;
 }
 
+namespace {
+
+/**
+ * Read the data pushes of script into vPushes, at most nMaxPushes of them.
+ * Fails on anything but pushes EvalScript would accept under flags.
+ */
+bool GetStandardPushes(const CScript& script, unsigned int flags, std::vector<valtype>& vPushes, size_t nMaxPushes)
+{
+    if (script.size() > MAX_SCRIPT_SIZE)
+        return false;
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (pc < script.end()) {
+        if (vPushes.size() == nMaxPushes)
+            return false;
+        vPushes.emplace_back();
+        if (!script.GetOp(pc, opcode, vPushes.back()) || opcode > OP_PUSHDATA4)
+            return false;
+        if (vPushes.back().size() > MAX_SCRIPT_ELEMENT_SIZE)
+            return false;
+        if ((flags & SCRIPT_VERIFY_MINIMALDATA) && !CheckMinimalPush(vPushes.back(), opcode))
+            return false;
+    }
+    return true;
+}
+
+/** Whether data hashes to the 20 bytes at hash with OP_HASH160. */
+bool Hash160Equals(const valtype& data, const unsigned char* hash)
+{
+    unsigned char vch[CHash160::OUTPUT_SIZE];
+    CHash160().Write(data.data(), data.size()).Finalize(vch);
+    return memcmp(vch, hash, sizeof(vch)) == 0;
+}
+
+/**
+ * OP_CHECKSIG of vchSig and vchPubKey over scriptCode, as EvalScript runs it
+ * with a single-opcode scriptPubKey or as the last opcode. serror is set on
+ * failure.
+ */
+bool StandardCheckSig(const valtype& vchSig, const valtype& vchPubKey, CScript scriptCode, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    scriptCode.FindAndDelete(CScript(vchSig));
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror))
+        return false;
+    if (checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE))
+        return true;
+    if ((flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
+        return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+    return set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+}
+
+/** Match OP_m <pubkey>... OP_n OP_CHECKMULTISIG, with 1 <= m <= n <= 16. */
+bool MatchMultisig(const CScript& script, int& nRequired, std::vector<valtype>& vPubKeys)
+{
+    if (script.size() < 3 || script.back() != OP_CHECKMULTISIG)
+        return false;
+    CScript::const_iterator pc = script.begin();
+    const CScript::const_iterator pend = script.end() - 2;
+    opcodetype opcode;
+    if (!script.GetOp(pc, opcode) || opcode < OP_1 || opcode > OP_16)
+        return false;
+    nRequired = CScript::DecodeOP_N(opcode);
+    while (pc < pend && (*pc == 33 || *pc == 65)) {
+        vPubKeys.emplace_back();
+        if (!script.GetOp(pc, opcode, vPubKeys.back()) || pc > pend)
+            return false;
+    }
+    return pc == pend && nRequired <= (int)vPubKeys.size() && vPubKeys.size() <= 16 && *pc == CScript::EncodeOP_N(vPubKeys.size());
+}
+
+} // namespace
+
+StandardScriptResult VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    // Witness data is only allowed next to witness programs, none of which
+    // are handled here.
+    if (witness != nullptr && !witness->IsNull())
+        return STANDARD_SCRIPT_NO_MATCH;
+
+    std::vector<valtype> vPushes;
+
+    // <sig> <pubkey> | OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG
+    if (scriptPubKey.size() == 25 && scriptPubKey[0] == OP_DUP && scriptPubKey[1] == OP_HASH160 && scriptPubKey[2] == 20 &&
+        scriptPubKey[23] == OP_EQUALVERIFY && scriptPubKey[24] == OP_CHECKSIG) {
+        if (!GetStandardPushes(scriptSig, flags, vPushes, 2) || vPushes.size() != 2)
+            return STANDARD_SCRIPT_NO_MATCH;
+        if (!Hash160Equals(vPushes[1], &scriptPubKey[3])) {
+            set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+            return STANDARD_SCRIPT_INVALID;
+        }
+        if (!StandardCheckSig(vPushes[0], vPushes[1], scriptPubKey, flags, checker, serror))
+            return STANDARD_SCRIPT_INVALID;
+        set_success(serror);
+        return STANDARD_SCRIPT_VALID;
+    }
+
+    // <sig> | <pubkey> OP_CHECKSIG
+    if (((scriptPubKey.size() == 35 && scriptPubKey[0] == 33) ||
+         (scriptPubKey.size() == 67 && scriptPubKey[0] == 65)) &&
+        scriptPubKey.back() == OP_CHECKSIG) {
+        if (!GetStandardPushes(scriptSig, flags, vPushes, 1) || vPushes.size() != 1)
+            return STANDARD_SCRIPT_NO_MATCH;
+        const valtype vchPubKey(scriptPubKey.begin() + 1, scriptPubKey.end() - 1);
+        if (!StandardCheckSig(vPushes[0], vchPubKey, scriptPubKey, flags, checker, serror))
+            return STANDARD_SCRIPT_INVALID;
+        set_success(serror);
+        return STANDARD_SCRIPT_VALID;
+    }
+
+    // OP_0 <sig>... <redeemScript> | OP_HASH160 <hash> OP_EQUAL, where
+    // redeemScript is OP_m <pubkey>... OP_n OP_CHECKMULTISIG. Only exactly m
+    // signatures are handled, so that the spend leaves a clean stack.
+    if ((flags & SCRIPT_VERIFY_P2SH) && scriptPubKey.IsPayToScriptHash()) {
+        if (!GetStandardPushes(scriptSig, flags, vPushes, 18) || vPushes.size() < 3)
+            return STANDARD_SCRIPT_NO_MATCH;
+        const CScript redeemScript(vPushes.back().begin(), vPushes.back().end());
+        int nRequired;
+        std::vector<valtype> vPubKeys;
+        if (!MatchMultisig(redeemScript, nRequired, vPubKeys) || (int)vPushes.size() != nRequired + 2)
+            return STANDARD_SCRIPT_NO_MATCH;
+        if (!Hash160Equals(vPushes.back(), &scriptPubKey[2])) {
+            set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+            return STANDARD_SCRIPT_INVALID;
+        }
+
+        CScript scriptCode(redeemScript);
+        for (int k = nRequired; k > 0; k--)
+            scriptCode.FindAndDelete(CScript(vPushes[k]));
+
+        // Signatures and keys are matched from the top of the stack down,
+        // which is from the last of each, in the same order and with the same
+        // early exit as OP_CHECKMULTISIG, so that failures are reported alike.
+        int isig = nRequired, ikey = vPubKeys.size() - 1;
+        bool fSuccess = true;
+        while (fSuccess && isig > 0) {
+            const valtype& vchSig = vPushes[isig];
+            const valtype& vchPubKey = vPubKeys[ikey];
+            if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, SIGVERSION_BASE, serror))
+                return STANDARD_SCRIPT_INVALID;
+            if (checker.CheckSig(vchSig, vchPubKey, scriptCode, SIGVERSION_BASE))
+                isig--;
+            ikey--;
+            if (isig > ikey + 1)
+                fSuccess = false;
+        }
+        if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL)) {
+            for (int k = 1; k <= nRequired; k++) {
+                if (vPushes[k].size()) {
+                    set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+                    return STANDARD_SCRIPT_INVALID;
+                }
+            }
+        }
+        if ((flags & SCRIPT_VERIFY_NULLDUMMY) && !vPushes[0].empty()) {
+            set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
+            return STANDARD_SCRIPT_INVALID;
+        }
+        if (!fSuccess) {
+            set_error(serror, SCRIPT_ERR_EVAL_FALSE);
+            return STANDARD_SCRIPT_INVALID;
+        }
+        set_success(serror);
+        return STANDARD_SCRIPT_VALID;
+    }
+
+    return STANDARD_SCRIPT_NO_MATCH;
+}
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
+{
+    // A spend matching a standard template gets its final result from the
+    // shortcut, so failing signatures are not verified twice.
+    StandardScriptResult result = VerifyStandardScript(scriptSig, scriptPubKey, witness, flags, checker, serror);
+    if (result != STANDARD_SCRIPT_NO_MATCH)
+        return result == STANDARD_SCRIPT_VALID;
+    return VerifyScriptInterpreted(scriptSig, scriptPubKey, witness, flags, checker, serror);
+}
+
+bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror)
 {
     static const CScriptWitness emptyWitness;
     if (witness == nullptr) {
@@ -6,9 +6,11 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "hash.h"
 #include "script_error.h"
 #include "primitives/transaction.h"
 
+#include <atomic>
 #include <vector>
 #include <stdint.h>
 #include <string>
@@ -121,9 +123,49 @@ bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned i
 
 struct PrecomputedTransactionData
 {
-    uint256 hashPrevouts, hashSequence, hashOutputs;
+    mutable uint256 hashPrevouts, hashSequence, hashOutputs;
 
     PrecomputedTransactionData(const CTransaction& tx);
+
+    /**
+     * Deferred form: the hashes are computed by the first signature check
+     * that needs them, so transactions without witness inputs never pay
+     * for them and block validation computes them on the script check
+     * threads.
+     */
+    PrecomputedTransactionData();
+    PrecomputedTransactionData(const PrecomputedTransactionData& other);
+
+    /**
+     * Return this object once its hashes for txTo are available, computing
+     * them if no other thread has started to. Returns nullptr while another
+     * thread is still filling them in; the caller then hashes txTo itself
+     * rather than waiting.
+     */
+    const PrecomputedTransactionData* Ready(const CTransaction& txTo) const;
+
+    /**
+     * Legacy (non-segwit) SIGHASH_ALL state, with or without the FORKID
+     * flags: the inputs serialized with their scriptSigs blanked, the
+     * serialized outputs and nLockTime, and a hasher midstate every
+     * LEGACY_MIDSTATE_INTERVAL inputs into that serialization. Hashing input
+     * nIn then resumes from the nearest midstate instead of re-serializing
+     * the whole transaction through CTransactionSignatureSerializer.
+     */
+    static const unsigned int LEGACY_MIDSTATE_INTERVAL = 16;
+    mutable std::vector<unsigned char> legacyInputs, legacyTail;
+    mutable std::vector<CHashWriter> legacyMidstates;
+
+    /**
+     * Like Ready(), for the legacy state. Also returns nullptr for
+     * transactions with a single input, which gain nothing from it.
+     */
+    const PrecomputedTransactionData* ReadyLegacy(const CTransaction& txTo) const;
+
+private:
+    enum { EMPTY, FILLING, READY };
+    mutable std::atomic<int> state;
+    mutable std::atomic<int> legacyState;
 };
 
 enum SigVersion
@@ -186,6 +228,23 @@ public:
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* error = nullptr);
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = nullptr);
 
+enum StandardScriptResult
+{
+    STANDARD_SCRIPT_NO_MATCH, //!< not a spend handled by the shortcut
+    STANDARD_SCRIPT_VALID,
+    STANDARD_SCRIPT_INVALID,
+};
+
+/**
+ * Verify a spend of a P2PKH, P2PK or P2SH multisig output without running the
+ * interpreter. For a spend it handles, the result and serror are what the
+ * interpreter would give; everything else returns STANDARD_SCRIPT_NO_MATCH and
+ * is left to the interpreter.
+ */
+StandardScriptResult VerifyStandardScript(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = nullptr);
+/** VerifyScript without the standard template shortcut. */
+bool VerifyScriptInterpreted(const CScript& scriptSig, const CScript& scriptPubKey, const CScriptWitness* witness, unsigned int flags, const BaseSignatureChecker& checker, ScriptError* serror = nullptr);
+
 bool IsCompressedOrUncompressedPubKey(const valtype &vchPubKey);
 bool IsLowDERSignature(const valtype &vchSig, ScriptError* serror, bool haveHashType = true);
 
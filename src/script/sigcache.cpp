@@ -5,11 +5,15 @@
 
 #include "sigcache.h"
 
+#include "clientversion.h"
+#include "fs.h"
 #include "memusage.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
+#include "utiltime.h"
 
 #include "cuckoocache.h"
 #include <boost/thread.hpp>
@@ -57,6 +61,25 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    //! Copy out the nonce and all live entries
+    void GetEntries(uint256& nonceOut, std::vector<uint256>& vEntries)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        setValid.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+    }
+
+    //! Replace the nonce and insert entries made with it. Entries made with
+    //! the old nonce can no longer be found, so this must run before the
+    //! cache is used.
+    void SetEntries(const uint256& nonceIn, const std::vector<uint256>& vEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (uint256 entry : vEntries)
+            setValid.insert(entry);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -80,6 +103,83 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+bool DumpCacheFile(const std::string& filename, const uint256& nonce, const std::vector<uint256>& vEntries)
+{
+    int64_t nStart = GetTimeMicros();
+    const fs::path path = GetDataDir() / filename;
+    const fs::path pathNew = GetDataDir() / (filename + ".new");
+    try {
+        FILE* filestr = fsbridge::fopen(pathNew, "wb");
+        if (!filestr) {
+            return false;
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIGCACHE_DUMP_VERSION;
+        file << (int)CLIENT_VERSION;
+        file << nonce;
+        file << vEntries;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathNew, path);
+        LogPrintf("Dumped %u entries to %s: %gs\n", vEntries.size(), filename, (GetTimeMicros() - nStart) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump %s: %s. Continuing anyway.\n", filename, e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadCacheFile(const std::string& filename, uint256& nonce, std::vector<uint256>& vEntries)
+{
+    int64_t nStart = GetTimeMicros();
+    CAutoFile file(fsbridge::fopen(GetDataDir() / filename, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+    try {
+        uint64_t version;
+        int nDumpClientVersion;
+        file >> version;
+        file >> nDumpClientVersion;
+        // Script execution entries record that a transaction passed with a
+        // set of script flags, which is only meaningful to the same
+        // interpreter, so files from any other version are dropped.
+        if (version != SIGCACHE_DUMP_VERSION || nDumpClientVersion != CLIENT_VERSION) {
+            return false;
+        }
+        uint256 nonceIn;
+        std::vector<uint256> vEntriesIn;
+        file >> nonceIn;
+        file >> vEntriesIn;
+        nonce = nonceIn;
+        vEntries.swap(vEntriesIn);
+        LogPrintf("Loaded %u entries from %s: %gs\n", vEntries.size(), filename, (GetTimeMicros() - nStart) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize %s: %s. Continuing anyway.\n", filename, e.what());
+        return false;
+    }
+    return true;
+}
+
+void DumpSignatureCache()
+{
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    signatureCache.GetEntries(nonce, vEntries);
+    DumpCacheFile("sigcache.dat", nonce, vEntries);
+}
+
+bool LoadSignatureCache()
+{
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    if (!LoadCacheFile("sigcache.dat", nonce, vEntries)) {
+        return false;
+    }
+    signatureCache.SetEntries(nonce, vEntries);
+    return true;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
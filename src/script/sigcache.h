@@ -8,6 +8,7 @@
 
 #include "script/interpreter.h"
 
+#include <string>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -16,6 +17,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+// Version of the signature and script execution cache files
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
 
 class CPubKey;
 
@@ -53,4 +56,26 @@ public:
 
 void InitSignatureCache();
 
+/**
+ * Write the nonce and entries of a salted cache to filename in the data
+ * directory, together with the format and client version.
+ */
+bool DumpCacheFile(const std::string& filename, const uint256& nonce, const std::vector<uint256>& vEntries);
+
+/**
+ * Read a file written by DumpCacheFile. Returns false, leaving nonce and
+ * vEntries alone, if the file is missing or unreadable, or was written with
+ * a different format or client version.
+ */
+bool LoadCacheFile(const std::string& filename, uint256& nonce, std::vector<uint256>& vEntries);
+
+/** Write the signature cache to sigcache.dat in the data directory. */
+void DumpSignatureCache();
+
+/**
+ * Fill the signature cache from sigcache.dat. Files written by a different
+ * client version are ignored. Must be called before the cache is used.
+ */
+bool LoadSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
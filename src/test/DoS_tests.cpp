@@ -41,6 +41,9 @@ CService ip(uint32_t i)
 static NodeId id = 0;
 
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds);
+void SetBlockInFlight(NodeId node, const uint256& hash, int64_t nTimeRequested);
+void SetBlockReceived(NodeId node, const uint256& hash, size_t nBytes);
+bool ShouldRerequestStalledBlock(NodeId nodeFaster, NodeId nodeStaller, int64_t nTimeRequested, int64_t nNow);
 
 BOOST_FIXTURE_TEST_SUITE(DoS_tests, TestingSetup)
 
@@ -71,14 +74,15 @@ BOOST_AUTO_TEST_CASE(outbound_slow_chain_eviction)
 
     // Test starts here
     peerLogic->SendMessages(&dummyNode1, interruptDummy); // should result in getheaders
-    BOOST_CHECK(dummyNode1.vSendMsg.size() > 0);
-    dummyNode1.vSendMsg.clear();
+    BOOST_CHECK(!dummyNode1.IsSendQueueEmpty());
+    for (auto& queue : dummyNode1.vSendMsg)
+        queue.clear();
 
     int64_t nStartTime = GetTime();
     // Wait 21 minutes
     SetMockTime(nStartTime+21*60);
     peerLogic->SendMessages(&dummyNode1, interruptDummy); // should result in getheaders
-    BOOST_CHECK(dummyNode1.vSendMsg.size() > 0);
+    BOOST_CHECK(!dummyNode1.IsSendQueueEmpty());
     // Wait 3 more minutes
     SetMockTime(nStartTime+24*60);
     peerLogic->SendMessages(&dummyNode1, interruptDummy); // should result in disconnect
@@ -172,6 +176,58 @@ BOOST_AUTO_TEST_CASE(stale_tip_peer_management)
     CConnmanTest::ClearNodes();
 }
 
+BOOST_AUTO_TEST_CASE(block_download_window)
+{
+    CAddress addr1(ip(0xa0b0c001), NODE_NONE);
+    CNode dummyNode1(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr1, 0, 0, CAddress(), "", true);
+    dummyNode1.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode1);
+    CAddress addr2(ip(0xa0b0c002), NODE_NONE);
+    CNode dummyNode2(id++, NODE_NETWORK, 0, INVALID_SOCKET, addr2, 1, 1, CAddress(), "", true);
+    dummyNode2.SetSendVersion(PROTOCOL_VERSION);
+    peerLogic->InitializeNode(&dummyNode2);
+    const NodeId faster = dummyNode1.GetId();
+    const NodeId staller = dummyNode2.GetId();
+
+    // The window grows by one for a block that arrives quickly, and shrinks
+    // by a quarter for one that does not
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(faster, stats));
+    const int nLimit = stats.nBlocksInFlightLimit;
+    uint256 hashSlow = GetRandHash();
+    SetBlockInFlight(faster, hashSlow, GetTimeMicros() - BLOCK_DOWNLOAD_TARGET_LATENCY * 2);
+    SetBlockReceived(faster, hashSlow, 1000);
+    BOOST_CHECK(GetNodeStateStats(faster, stats));
+    BOOST_CHECK_EQUAL(stats.nBlocksInFlightLimit, std::max(nLimit * 3 / 4, MIN_BLOCKS_IN_TRANSIT_PER_PEER));
+    const int nShrunk = stats.nBlocksInFlightLimit;
+    uint256 hashFast = GetRandHash();
+    SetBlockInFlight(faster, hashFast, GetTimeMicros() - BLOCK_DOWNLOAD_TARGET_LATENCY / 4);
+    SetBlockReceived(faster, hashFast, 1000);
+    BOOST_CHECK(GetNodeStateStats(faster, stats));
+    BOOST_CHECK_EQUAL(stats.nBlocksInFlightLimit, nShrunk + 1);
+    BOOST_CHECK_EQUAL(stats.nBlocksDownloaded, 2);
+    const int64_t nLatency = stats.nBlockDownloadLatency;
+
+    // A block stalled at a peer that never delivered one moves to the faster
+    // peer once that would likely have delivered it, but only if it is idle
+    uint256 hashStalled = GetRandHash();
+    const int64_t nNow = GetTimeMicros();
+    SetBlockInFlight(staller, hashStalled, nNow);
+    BOOST_CHECK(!ShouldRerequestStalledBlock(faster, staller, nNow, nNow + nLatency));
+    BOOST_CHECK(ShouldRerequestStalledBlock(faster, staller, nNow, nNow + 3 * nLatency));
+    uint256 hashBusy = GetRandHash();
+    SetBlockInFlight(faster, hashBusy, nNow);
+    BOOST_CHECK(!ShouldRerequestStalledBlock(faster, staller, nNow, nNow + 3 * nLatency));
+    SetBlockReceived(faster, hashBusy, 1000);
+    BOOST_CHECK(ShouldRerequestStalledBlock(faster, staller, nNow, nNow + 3 * nLatency));
+    // Nor is it moved to a peer that has never delivered a block
+    BOOST_CHECK(!ShouldRerequestStalledBlock(staller, faster, nNow, nNow + 3 * nLatency));
+
+    bool dummy;
+    peerLogic->FinalizeNode(faster, dummy);
+    peerLogic->FinalizeNode(staller, dummy);
+}
+
 BOOST_AUTO_TEST_CASE(DoS_banning)
 {
     std::atomic<bool> interruptDummy(false);
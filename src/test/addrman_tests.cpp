@@ -217,6 +217,44 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_sparse)
+{
+    CAddrManTest addrman;
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    // Spread addresses over many groups, then move every other one to tried.
+    std::vector<CService> vAddr;
+    for (unsigned int i = 1; i <= 40; i++) {
+        CService addr = ResolveService("250." + boost::to_string(i) + ".1.1", 8998);
+        addrman.Add(CAddress(addr, NODE_NONE), source);
+        vAddr.push_back(addr);
+    }
+    BOOST_CHECK_EQUAL(addrman.size(), 40);
+    for (unsigned int i = 0; i < vAddr.size(); i += 2) {
+        addrman.Good(CAddress(vAddr[i], NODE_NONE));
+    }
+
+    // Test: newOnly selection only ever returns entries from the new table,
+    // and every selection returns a known entry.
+    for (int i = 0; i < 100; i++) {
+        CAddrInfo addr_new = addrman.Select(true);
+        auto it = std::find(vAddr.begin(), vAddr.end(), (CService)addr_new);
+        BOOST_REQUIRE(it != vAddr.end());
+        BOOST_CHECK((it - vAddr.begin()) % 2 == 1);
+
+        CAddrInfo addr_any = addrman.Select();
+        BOOST_CHECK(addrman.Find(addr_any) != nullptr);
+    }
+
+    // Test: once the new table is emptied, newOnly selection returns nothing.
+    for (unsigned int i = 1; i < vAddr.size(); i += 2) {
+        addrman.Good(CAddress(vAddr[i], NODE_NONE));
+    }
+    BOOST_CHECK_EQUAL(addrman.Select(true).ToString(), "[::]:0");
+    BOOST_CHECK(addrman.Find(addrman.Select()) != nullptr);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -314,6 +314,27 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(ShortTxIDIndexTest)
+{
+    ShortTxIDIndex index(1000);
+    uint16_t pos;
+    BOOST_CHECK(!index.Find(0, pos));
+
+    // Short ids which only differ in their upper bits must still spread over the table
+    for (uint64_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(index.Insert(i << 32, i));
+    }
+    BOOST_CHECK(!index.Insert(42ULL << 32, 0)); // Collision
+    BOOST_CHECK_EQUAL(index.size(), 1000U);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+        BOOST_CHECK(index.Find(i << 32, pos));
+        BOOST_CHECK_EQUAL(pos, i);
+    }
+    BOOST_CHECK(!index.Find(1000ULL << 32, pos));
+    BOOST_CHECK(!index.Find(1, pos));
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -10,6 +10,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -268,6 +269,26 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Cover every mix of the 8-, 4-, 2- and 1-way paths.
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // In place, as the merkle code uses it.
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
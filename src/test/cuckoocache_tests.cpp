@@ -2,10 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <boost/test/unit_test.hpp>
+#include "clientversion.h"
 #include "cuckoocache.h"
+#include "fs.h"
 #include "script/sigcache.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "random.h"
+#include <set>
 #include <thread>
 
 /** Test Suite for CuckooCache
@@ -377,4 +381,100 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each visits exactly the entries that were inserted and not
+ * erased, so a dumped cache can be reloaded with the same contents.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_ok)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // Erase every other entry
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        BOOST_CHECK(cc.contains(hashes[i], true));
+
+    std::set<uint256> seen;
+    cc.for_each([&seen](const uint256& h) { seen.insert(h); });
+    BOOST_CHECK_EQUAL(seen.size(), hashes.size() / 2);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(seen.count(hashes[i]), i % 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    for (const uint256& h : seen)
+        reloaded.insert(h);
+    for (size_t i = 1; i < hashes.size(); i += 2)
+        BOOST_CHECK(reloaded.contains(hashes[i], false));
+}
+
+/* Test that a cache written with DumpCacheFile comes back from LoadCacheFile
+ * into an empty cache with its nonce and exactly its live entries.
+ */
+BOOST_FIXTURE_TEST_CASE(cuckoocache_dump_load_ok, TestingSetup)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        BOOST_CHECK(cc.contains(hashes[i], true));
+
+    uint256 nonce;
+    insecure_GetRandHash(nonce);
+    std::vector<uint256> vEntries;
+    cc.for_each([&vEntries](const uint256& h) { vEntries.push_back(h); });
+    BOOST_CHECK(DumpCacheFile("testcache.dat", nonce, vEntries));
+
+    // As after a restart, load into a fresh cache
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    uint256 nonceLoaded;
+    std::vector<uint256> vLoaded;
+    BOOST_CHECK(LoadCacheFile("testcache.dat", nonceLoaded, vLoaded));
+    BOOST_CHECK(nonceLoaded == nonce);
+    for (uint256& h : vLoaded)
+        reloaded.insert(h);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(reloaded.contains(hashes[i], false), i % 2 == 1);
+
+    BOOST_CHECK(!LoadCacheFile("missingcache.dat", nonceLoaded, vLoaded));
+}
+
+/* Test that files from another format or client version are not loaded.
+ */
+BOOST_FIXTURE_TEST_CASE(cuckoocache_load_version_mismatch, TestingSetup)
+{
+    uint256 nonce;
+    insecure_GetRandHash(nonce);
+    const std::vector<uint256> vEntries(10, nonce);
+
+    const std::vector<std::pair<uint64_t, int>> versions{
+        {SIGCACHE_DUMP_VERSION + 1, CLIENT_VERSION},
+        {SIGCACHE_DUMP_VERSION, CLIENT_VERSION - 1},
+    };
+    for (const auto& version : versions) {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "testcache.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        file << version.first;
+        file << version.second;
+        file << nonce;
+        file << vEntries;
+        file.fclose();
+
+        uint256 nonceLoaded;
+        std::vector<uint256> vLoaded;
+        BOOST_CHECK(!LoadCacheFile("testcache.dat", nonceLoaded, vLoaded));
+        BOOST_CHECK(nonceLoaded.IsNull());
+        BOOST_CHECK(vLoaded.empty());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -3,6 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "pow.h"
 #include "validation.h"
 #include "net.h"
 
@@ -74,4 +77,87 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+static CBlock BuildCheckBlockTestBlock(size_t nTxs)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 1; i < nTxs; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_parallel_tx_checks)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    BOOST_CHECK(nScriptCheckThreads > 1);
+    CBlock block = BuildCheckBlockTestBlock(2 * MIN_BLOCK_TXS_FOR_PARALLEL_CHECK);
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, consensusParams, false));
+
+    // A bad transaction deep in the block is reported as the serial check would.
+    CMutableTransaction tx(*block.vtx[MIN_BLOCK_TXS_FOR_PARALLEL_CHECK + 3]);
+    tx.vout[0].nValue = -1;
+    block.vtx[MIN_BLOCK_TXS_FOR_PARALLEL_CHECK + 3] = MakeTransactionRef(tx);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(!CheckBlock(block, state, consensusParams, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-vout-negative");
+
+    // Sigops counted on the worker threads add up over the whole block.
+    block = BuildCheckBlockTestBlock(2 * MIN_BLOCK_TXS_FOR_PARALLEL_CHECK);
+    const unsigned int nSigOpsPerTx = MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR / (block.vtx.size() - 1);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        CMutableTransaction mtx(*block.vtx[i]);
+        mtx.vout[0].scriptPubKey = CScript();
+        for (unsigned int j = 0; j < nSigOpsPerTx; j++)
+            mtx.vout[0].scriptPubKey << OP_CHECKSIG;
+        block.vtx[i] = MakeTransactionRef(mtx);
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    state = CValidationState();
+    BOOST_CHECK(CheckBlock(block, state, consensusParams, false));
+    CMutableTransaction extra(*block.vtx[1]);
+    for (unsigned int j = nSigOpsPerTx * (block.vtx.size() - 1); j <= MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR; j++)
+        extra.vout[0].scriptPubKey << OP_CHECKSIG;
+    block.vtx[1] = MakeTransactionRef(extra);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(!CheckBlock(block, state, consensusParams, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-sigops");
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_caches_hash)
+{
+    Consensus::Params consensusParams = Params().GetConsensus();
+    consensusParams.powLimit = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
+    CBlock block = BuildCheckBlockTestBlock(2);
+    block.nBits = UintToArith256(consensusParams.powLimit).GetCompact();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+        ++block.nNonce;
+
+    CValidationState state;
+    BOOST_CHECK(!block.fChecked);
+    BOOST_CHECK(CheckBlock(block, state, consensusParams));
+    BOOST_CHECK(block.fChecked);
+    const CBlockHeader& header = block;
+    BOOST_CHECK(header.GetHash() == block.CBlockHeader::GetHash());
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == block.GetHash());
+
+    block.SetNull();
+    BOOST_CHECK(!block.fChecked);
+    BOOST_CHECK(block.GetHash() == block.CBlockHeader::GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -427,6 +427,63 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
     CheckSort<ancestor_score>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolInfoSortedTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    /* low fee parent with high fee child */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_11;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(50000LL).FromTx(tx2));
+
+    /* unrelated transactions */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx3.vout[0].nValue = 5 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(20000LL).FromTx(tx3));
+
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx4.vout[0].nValue = 6 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(0LL).FromTx(tx4));
+
+    CMutableTransaction txMissing = CMutableTransaction();
+    txMissing.vout.resize(1);
+    txMissing.vout[0].nValue = 7 * COIN;
+
+    // The child comes after its parent despite its higher fee, and
+    // transactions that are not in the pool are skipped.
+    std::vector<uint256> vHashes{tx2.GetHash(), txMissing.GetHash(), tx1.GetHash(), tx3.GetHash()};
+    std::vector<TxMempoolInfo> vInfo = pool.infoSorted(vHashes);
+    BOOST_CHECK_EQUAL(vInfo.size(), 3);
+    BOOST_CHECK(vInfo[0].tx->GetHash() == tx3.GetHash());
+    BOOST_CHECK(vInfo[1].tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK(vInfo[2].tx->GetHash() == tx2.GetHash());
+
+    // Sorting everything matches infoAll.
+    std::vector<TxMempoolInfo> vAll = pool.infoAll();
+    vHashes = {tx4.GetHash(), tx3.GetHash(), tx2.GetHash(), tx1.GetHash()};
+    vInfo = pool.infoSorted(vHashes);
+    BOOST_CHECK_EQUAL(vInfo.size(), vAll.size());
+    for (size_t i = 0; i < vInfo.size(); i++) {
+        BOOST_CHECK(vInfo[i].tx->GetHash() == vAll[i].tx->GetHash());
+    }
+}
+
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
@@ -533,23 +590,16 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(tx6.GetHash(), entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7));
 
-    // we only require this remove, at max, 2 txn, because its not clear what we're really optimizing for aside from that
+    // the cluster linearizes into [tx4] and [tx5, tx6, tx7]; tx7 needs both
+    // tx5 and tx6, so the whole lower feerate chunk is evicted together
     pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
     BOOST_CHECK(pool.exists(tx4.GetHash()));
-    BOOST_CHECK(pool.exists(tx6.GetHash()));
-    BOOST_CHECK(!pool.exists(tx7.GetHash()));
-
-    if (!pool.exists(tx5.GetHash()))
-        pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5));
-    pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7));
-
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
-    BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
-    BOOST_CHECK(pool.exists(tx6.GetHash()));
+    BOOST_CHECK(!pool.exists(tx6.GetHash()));
     BOOST_CHECK(!pool.exists(tx7.GetHash()));
 
     pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(tx6.GetHash(), entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7));
 
     std::vector<CTransactionRef> vtx;
@@ -581,4 +631,172 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClusterLinearizeTest)
+{
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A low fee parent with two children: one pays for the parent (CPFP),
+    // the other pays less than the parent and should be linearized last.
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(2);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    tx1.vout[1].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[1].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(50000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx1.GetHash(), 1);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(500LL).FromTx(tx3));
+
+    // An unrelated transaction is not part of the cluster
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(1);
+    tx4.vin[0].scriptSig = CScript() << OP_4;
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_4 << OP_EQUAL;
+    tx4.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(2000LL).FromTx(tx4));
+
+    CTxMemPool::setEntries setCluster;
+    BOOST_CHECK(pool.CalculateCluster(pool.mapTx.find(tx3.GetHash()), setCluster, MAX_CLUSTER_LINEARIZE_COUNT));
+    BOOST_CHECK_EQUAL(setCluster.size(), 3U);
+    BOOST_CHECK(!setCluster.count(pool.mapTx.find(tx4.GetHash())));
+
+    setCluster.clear();
+    BOOST_CHECK(!pool.CalculateCluster(pool.mapTx.find(tx3.GetHash()), setCluster, 2));
+
+    setCluster.clear();
+    pool.CalculateCluster(pool.mapTx.find(tx1.GetHash()), setCluster, MAX_CLUSTER_LINEARIZE_COUNT);
+    std::vector<CTxMemPool::TxChunk> vChunks;
+    pool.LinearizeCluster(setCluster, vChunks);
+    BOOST_CHECK_EQUAL(vChunks.size(), 2U);
+    BOOST_CHECK_EQUAL(vChunks[0].vTx.size(), 2U);
+    BOOST_CHECK(vChunks[0].vTx[0]->GetTx().GetHash() == tx1.GetHash());
+    BOOST_CHECK(vChunks[0].vTx[1]->GetTx().GetHash() == tx2.GetHash());
+    BOOST_CHECK_EQUAL(vChunks[0].nModFees, 51000);
+    BOOST_CHECK_EQUAL(vChunks[1].vTx.size(), 1U);
+    BOOST_CHECK(vChunks[1].vTx[0]->GetTx().GetHash() == tx3.GetHash());
+    BOOST_CHECK(vChunks[1].GetFeeRate() < vChunks[0].GetFeeRate());
+
+    // Prioritising tx3 above everything makes it pull its parent into the first chunk
+    pool.PrioritiseTransaction(tx3.GetHash(), 200000LL);
+    pool.LinearizeCluster(setCluster, vChunks);
+    BOOST_CHECK_EQUAL(vChunks.size(), 2U);
+    BOOST_CHECK(vChunks[0].vTx[0]->GetTx().GetHash() == tx1.GetHash());
+    BOOST_CHECK(vChunks[0].vTx[1]->GetTx().GetHash() == tx3.GetHash());
+    BOOST_CHECK(vChunks[1].vTx[0]->GetTx().GetHash() == tx2.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolHasRoomForTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(5000LL).FromTx(tx2));
+
+    CFeeRate feerate2(5000LL, GetVirtualTransactionSize(tx2));
+    size_t nUsage = pool.DynamicMemoryUsage();
+
+    // Enough room without evicting anything
+    BOOST_CHECK(pool.HasRoomFor(0, CFeeRate(0), nUsage));
+    // Evicting tx2 makes room, but only for entries paying more than it
+    BOOST_CHECK(pool.HasRoomFor(1, CFeeRate(feerate2.GetFeePerK() + 1), nUsage));
+    BOOST_CHECK(!pool.HasRoomFor(1, feerate2, nUsage));
+    // Nothing is actually evicted
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    // Evicting everything is not enough to make room
+    BOOST_CHECK(!pool.HasRoomFor(nUsage, CFeeRate(MAX_MONEY), nUsage));
+
+    // Trimming stops short of a protected entry instead of evicting it
+    CTxMemPool::setEntries setProtected;
+    setProtected.insert(pool.mapTx.find(tx2.GetHash()));
+    pool.TrimToSize(1, nullptr, &setProtected);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    setProtected.clear();
+    setProtected.insert(pool.mapTx.find(tx1.GetHash()));
+    pool.TrimToSize(1, nullptr, &setProtected);
+    BOOST_CHECK(pool.exists(tx1.GetHash()));
+    BOOST_CHECK(!pool.exists(tx2.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(10000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(20000LL).FromTx(tx2));
+
+    std::shared_ptr<const TxMempoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2U);
+    for (const TxMempoolEntrySnapshot& e : snapshot->vEntries) {
+        if (e.txid == tx2.GetHash()) {
+            BOOST_CHECK_EQUAL(e.nFee, 20000);
+            BOOST_CHECK_EQUAL(e.nCountWithAncestors, 2U);
+            BOOST_CHECK(e.setDepends.size() == 1 && *e.setDepends.begin() == tx1.GetHash());
+        } else {
+            BOOST_CHECK(e.txid == tx1.GetHash());
+            BOOST_CHECK_EQUAL(e.nCountWithDescendants, 2U);
+            BOOST_CHECK(e.setDepends.empty());
+        }
+    }
+
+    // Unchanged mempool: the same view is handed out again
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+
+    // After a change a new view is built, while the old one stays intact
+    pool.removeRecursive(tx2);
+    std::shared_ptr<const TxMempoolSnapshot> snapshot2 = pool.GetSnapshot();
+    BOOST_CHECK(snapshot2 != snapshot);
+    BOOST_CHECK_EQUAL(snapshot2->vEntries.size(), 1U);
+    BOOST_CHECK_EQUAL(snapshot->vEntries.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "streams.h"
 #include "net.h"
 #include "netbase.h"
+#include "netmessagemaker.h"
 #include "chainparams.h"
 #include "util.h"
 
@@ -185,4 +186,48 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(cnode_send_priority)
+{
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::CMPCTBLOCK), SEND_PRIORITY_ANNOUNCE);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::HEADERS), SEND_PRIORITY_ANNOUNCE);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::VERSION), SEND_PRIORITY_ANNOUNCE);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::PING), SEND_PRIORITY_ANNOUNCE);
+    // Getdata responses, their trailing inv and pong keep their relative order
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::BLOCK), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::MERKLEBLOCK), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::TX), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::NOTFOUND), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::INV), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::PONG), SEND_PRIORITY_ORDERED);
+    BOOST_CHECK_EQUAL(GetSendPriority(NetMsgType::REJECT), SEND_PRIORITY_ORDERED);
+
+    // Without a socket nothing is sent, so the messages stay in their queues
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(CService(CNetAddr(), 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    std::vector<unsigned char> payload(1000);
+    connman.PushMessage(&node, msgMaker.Make(NetMsgType::BLOCK, payload));
+    connman.PushMessage(&node, msgMaker.Make(NetMsgType::TX, payload));
+    connman.PushMessage(&node, msgMaker.Make(NetMsgType::HEADERS, payload));
+    connman.PushMessage(&node, msgMaker.Make(NetMsgType::PONG, uint64_t(0)));
+    connman.PushMessage(&node, msgMaker.Make(NetMsgType::PING, uint64_t(0)));
+
+    LOCK(node.cs_vSend);
+    BOOST_CHECK(!node.IsSendQueueEmpty());
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ANNOUNCE].size(), 2U);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ANNOUNCE].front().command, NetMsgType::HEADERS);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ANNOUNCE].back().command, NetMsgType::PING);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ORDERED].size(), 3U);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ORDERED][0].command, NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ORDERED][1].command, NetMsgType::TX);
+    BOOST_CHECK_EQUAL(node.vSendMsg[SEND_PRIORITY_ORDERED][2].command, NetMsgType::PONG);
+    size_t nQueued = 0;
+    for (const auto& queue : node.vSendMsg) {
+        for (const CSendMsg& msg : queue)
+            nQueued += msg.size();
+    }
+    BOOST_CHECK_EQUAL(node.nSendSize, nQueued);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -80,6 +80,10 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" extra"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawpackage"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawpackage null"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawpackage []"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC("sendrawpackage [\"DEADBEEF\"]"), std::runtime_error);
 }
 
 BOOST_AUTO_TEST_CASE(rpc_togglenetwork)
@@ -166,6 +166,8 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, const CScript
     CMutableTransaction tx2 = tx;
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, &scriptWitness, flags, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err) == expect, message);
     BOOST_CHECK_MESSAGE(err == scriptError, std::string(FormatScriptError(err)) + " where " + std::string(FormatScriptError((ScriptError_t)scriptError)) + " expected: " + message);
+    BOOST_CHECK_MESSAGE(VerifyScriptInterpreted(scriptSig, scriptPubKey, &scriptWitness, flags, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err) == expect, message);
+    BOOST_CHECK_MESSAGE(err == scriptError, std::string(FormatScriptError(err)) + " where " + std::string(FormatScriptError((ScriptError_t)scriptError)) + " expected (interpreted): " + message);
 #if defined(HAVE_CONSENSUS_LIB)
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << tx2;
@@ -1148,6 +1150,72 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_INVALID_STACK_OPERATION, ScriptErrorString(err));
 }
 
+BOOST_AUTO_TEST_CASE(script_standard_fast_path)
+{
+    static const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_LOW_S |
+        SCRIPT_VERIFY_MINIMALDATA | SCRIPT_VERIFY_NULLDUMMY | SCRIPT_VERIFY_NULLFAIL | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK;
+    CKey key1, key2, key3;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(false);
+    key3.MakeNewKey(true);
+
+    // Each template spent correctly is accepted without the interpreter. A
+    // spend with a bad signature is rejected there too, with the error the
+    // interpreter gives; spends not matching a template are left to it.
+    CScript scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(key1.GetPubKey().GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CMutableTransaction txFrom = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), CScriptWitness(), txFrom);
+    CScript scriptSig = sign_multisig(scriptPubKey, key1, txTo);
+    scriptSig = CScript(scriptSig.begin() + 1, scriptSig.end()) << ToByteVector(key1.GetPubKey());
+    MutableTransactionSignatureChecker checker(&txTo, 0, txFrom.vout[0].nValue);
+    ScriptError err;
+    BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, nullptr, flags, checker, &err), STANDARD_SCRIPT_VALID);
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_OK);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(CScript() << OP_0 << ToByteVector(key1.GetPubKey()), scriptPubKey, nullptr, flags, checker, &err), STANDARD_SCRIPT_INVALID);
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_EVAL_FALSE);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(CScript() << OP_0 << ToByteVector(key3.GetPubKey()), scriptPubKey, nullptr, flags, checker, &err), STANDARD_SCRIPT_INVALID);
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_EQUALVERIFY);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig << OP_NOP, scriptPubKey, nullptr, flags, checker), STANDARD_SCRIPT_NO_MATCH);
+
+    scriptPubKey = CScript() << ToByteVector(key2.GetPubKey()) << OP_CHECKSIG;
+    txFrom = BuildCreditingTransaction(scriptPubKey);
+    txTo = BuildSpendingTransaction(CScript(), CScriptWitness(), txFrom);
+    scriptSig = sign_multisig(scriptPubKey, key2, txTo);
+    scriptSig = CScript(scriptSig.begin() + 1, scriptSig.end());
+    MutableTransactionSignatureChecker checker2(&txTo, 0, txFrom.vout[0].nValue);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, nullptr, flags, checker2), STANDARD_SCRIPT_VALID);
+    CScript badSig = sign_multisig(scriptPubKey, key1, txTo);
+    badSig = CScript(badSig.begin() + 1, badSig.end());
+    BOOST_CHECK_EQUAL(VerifyStandardScript(badSig, scriptPubKey, nullptr, flags, checker2, &err), STANDARD_SCRIPT_INVALID);
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_SIG_NULLFAIL);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(badSig, scriptPubKey, nullptr, flags & ~SCRIPT_VERIFY_NULLFAIL, checker2, &err), STANDARD_SCRIPT_INVALID);
+    BOOST_CHECK_EQUAL(err, SCRIPT_ERR_EVAL_FALSE);
+    CScriptWitness witness;
+    witness.stack.push_back(std::vector<unsigned char>(1));
+    BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, &witness, flags, checker2), STANDARD_SCRIPT_NO_MATCH);
+
+    CScript redeemScript = CScript() << OP_2 << ToByteVector(key1.GetPubKey()) << ToByteVector(key2.GetPubKey()) << ToByteVector(key3.GetPubKey()) << OP_3 << OP_CHECKMULTISIG;
+    scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    txFrom = BuildCreditingTransaction(scriptPubKey);
+    txTo = BuildSpendingTransaction(CScript(), CScriptWitness(), txFrom);
+    MutableTransactionSignatureChecker checker3(&txTo, 0, txFrom.vout[0].nValue);
+    for (const auto& keys : std::vector<std::vector<CKey>>{{key1, key2}, {key1, key3}, {key2, key3}}) {
+        scriptSig = sign_multisig(redeemScript, keys, txTo) << ToByteVector(redeemScript);
+        BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, nullptr, flags, checker3), STANDARD_SCRIPT_VALID);
+        BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey, nullptr, flags, checker3));
+    }
+    for (const auto& keys : std::vector<std::vector<CKey>>{{key2, key1}, {key3, key3}}) {
+        scriptSig = sign_multisig(redeemScript, keys, txTo) << ToByteVector(redeemScript);
+        BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, nullptr, flags, checker3, &err), STANDARD_SCRIPT_INVALID);
+        BOOST_CHECK_EQUAL(err, SCRIPT_ERR_SIG_NULLFAIL);
+        BOOST_CHECK(!VerifyScriptInterpreted(scriptSig, scriptPubKey, nullptr, flags, checker3, &err));
+        BOOST_CHECK_EQUAL(err, SCRIPT_ERR_SIG_NULLFAIL);
+    }
+    scriptSig = sign_multisig(redeemScript, std::vector<CKey>{key1}, txTo) << ToByteVector(redeemScript);
+    BOOST_CHECK_EQUAL(VerifyStandardScript(scriptSig, scriptPubKey, nullptr, flags, checker3), STANDARD_SCRIPT_NO_MATCH);
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, nullptr, flags, checker3));
+}
+
 BOOST_AUTO_TEST_CASE(script_combineSigs)
 {
     // Test the CombineSignatures function
@@ -163,6 +163,46 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    SeedInsecureRand(false);
+
+    for (int i = 0; i < 5000; i++) {
+        int nHashType = InsecureRand32();
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE);
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata;
+        for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) ==
+                        SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE));
+        }
+    }
+
+    // Inputs on both sides of a midstate boundary
+    CMutableTransaction txTo;
+    RandomTransaction(txTo, false);
+    txTo.vin.resize(PrecomputedTransactionData::LEGACY_MIDSTATE_INTERVAL * 3 + 1, txTo.vin[0]);
+    for (unsigned int nIn = 0; nIn < txTo.vin.size(); nIn++) {
+        txTo.vin[nIn].prevout.n = nIn;
+    }
+    const CTransaction tx(txTo);
+    PrecomputedTransactionData txdata;
+    CScript scriptCode = CScript() << OP_1 << OP_CODESEPARATOR << OP_CHECKSIG;
+    for (unsigned int nIn = 0; nIn < tx.vin.size(); nIn++) {
+        for (int nHashType : {(int)SIGHASH_ALL, SIGHASH_ALL | SIGHASH_FORKID, SIGHASH_ALL | SIGHASH_FORKID_SHIFT}) {
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE, &txdata) ==
+                        SignatureHash(scriptCode, tx, nIn, nHashType, 0, SIGVERSION_BASE));
+        }
+    }
+    PrecomputedTransactionData txdataCopy(txdata);
+    BOOST_CHECK(txdataCopy.ReadyLegacy(tx) == &txdataCopy);
+    BOOST_CHECK(SignatureHash(scriptCode, tx, 20, SIGHASH_ALL, 0, SIGVERSION_BASE, &txdataCopy) ==
+                SignatureHash(scriptCode, tx, 20, SIGHASH_ALL, 0, SIGVERSION_BASE));
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
@@ -8,6 +8,7 @@
 
 #include "consensus/merkle.h"
 #include "primitives/block.h"
+#include "script/interpreter.h"
 #include "script/script.h"
 #include "addrman.h"
 #include "chain.h"
@@ -19,6 +20,7 @@
 #include "undo.h"
 #include "version.h"
 #include "pubkey.h"
+#include "hash.h"
 
 #include <stdint.h>
 #include <unistd.h>
@@ -45,6 +47,7 @@ enum TEST_ID {
     CBLOOMFILTER_DESERIALIZE,
     CDISKBLOCKINDEX_DESERIALIZE,
     CTXOUTCOMPRESSOR_DESERIALIZE,
+    STANDARD_SCRIPT_VERIFY,
     TEST_ID_END
 };
 
@@ -59,6 +62,24 @@ bool read_stdin(std::vector<char> &data) {
     return length==0;
 }
 
+/**
+ * Signature checker whose verdict is a deterministic function of everything
+ * it is given, so that both verification paths must agree on the scriptCode
+ * and the order in which signatures and keys are paired.
+ */
+class FuzzSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override
+    {
+        if (vchSig.empty())
+            return false;
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << vchSig << vchPubKey << scriptCode << (int)sigversion;
+        return (ss.GetHash().GetCheapHash() & 1) != 0;
+    }
+};
+
 int do_fuzz()
 {
     std::vector<char> buffer;
@@ -249,6 +270,43 @@ int do_fuzz()
 
             break;
         }
+        case STANDARD_SCRIPT_VERIFY:
+        {
+            unsigned int flags;
+            unsigned char nTemplate;
+            CScript scriptSig, scriptPubKey;
+            CScriptWitness witness;
+            try
+            {
+                ds >> flags >> nTemplate >> scriptSig >> scriptPubKey >> witness.stack;
+            } catch (const std::ios_base::failure& e) {return 0;}
+
+            // Optionally commit scriptPubKey to the last push of scriptSig as
+            // P2PKH or P2SH, which random input would never hash to.
+            if (nTemplate % 3) {
+                std::vector<unsigned char> vchLast, vch;
+                opcodetype opcode;
+                for (CScript::const_iterator pc = scriptSig.begin(); pc < scriptSig.end() && scriptSig.GetOp(pc, opcode, vch); )
+                    vchLast = vch;
+                uint160 hash = Hash160(vchLast);
+                std::vector<unsigned char> vchHash(hash.begin(), hash.end());
+                if (nTemplate % 3 == 1)
+                    scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchHash << OP_EQUALVERIFY << OP_CHECKSIG;
+                else
+                    scriptPubKey = CScript() << OP_HASH160 << vchHash << OP_EQUAL;
+            }
+
+            // VerifyScript asserts these flag dependencies
+            if ((flags & SCRIPT_VERIFY_CLEANSTACK) && !(flags & SCRIPT_VERIFY_WITNESS)) return 0;
+            if ((flags & SCRIPT_VERIFY_WITNESS) && !(flags & SCRIPT_VERIFY_P2SH)) return 0;
+
+            FuzzSignatureChecker checker;
+            ScriptError serror, serrorInterpreted;
+            bool fValid = VerifyScript(scriptSig, scriptPubKey, &witness, flags, checker, &serror);
+            bool fValidInterpreted = VerifyScriptInterpreted(scriptSig, scriptPubKey, &witness, flags, checker, &serrorInterpreted);
+            if (fValid != fValidInterpreted || serror != serrorInterpreted) abort();
+            break;
+        }
         default:
             return 0;
     }
@@ -281,6 +281,77 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(tx, state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+static void CheckDeserializedHashes(const CTransaction& tx, const CTransaction& ref)
+{
+    BOOST_CHECK(tx.GetHash() == ref.GetHash());
+    BOOST_CHECK(tx.GetWitnessHash() == ref.GetWitnessHash());
+    BOOST_CHECK_EQUAL(tx.GetTotalSize(), ref.GetTotalSize());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION), ::GetSerializeSize(ref, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS), ::GetSerializeSize(ref, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS));
+    BOOST_CHECK_EQUAL(GetTransactionWeight(tx), GetTransactionWeight(ref));
+}
+
+BOOST_AUTO_TEST_CASE(deserialize_cached_hashes)
+{
+    for (int i = 0; i < 1000; i++) {
+        CMutableTransaction mtx;
+        mtx.nVersion = InsecureRand32();
+        mtx.nLockTime = InsecureRand32();
+        mtx.vin.resize(InsecureRandRange(4) + 1);
+        for (CTxIn& txin : mtx.vin) {
+            txin.prevout = COutPoint(InsecureRand256(), InsecureRand32());
+            txin.scriptSig = CScript() << std::vector<unsigned char>(InsecureRandRange(100), 0x01);
+            txin.nSequence = InsecureRand32();
+            if (i % 2) txin.scriptWitness.stack.resize(InsecureRandRange(3));
+            for (auto& item : txin.scriptWitness.stack) {
+                item.resize(InsecureRandRange(300), 0x5a);
+            }
+        }
+        mtx.vout.resize(InsecureRandRange(4));
+        for (CTxOut& txout : mtx.vout) {
+            txout.nValue = InsecureRandRange(MAX_MONEY);
+            txout.scriptPubKey = CScript() << OP_RETURN << InsecureRandRange(1000);
+        }
+        const CTransaction ref(mtx);
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << ref;
+        CTransaction tx(deserialize, ss);
+        CheckDeserializedHashes(tx, ref);
+
+        // Reading without witness data strips it.
+        for (CTxIn& txin : mtx.vin) {
+            txin.scriptWitness.SetNull();
+        }
+        const CTransaction stripped(mtx);
+        CDataStream ssNoWitness(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        ssNoWitness << ref;
+        CTransaction txNoWitness(deserialize, ssNoWitness);
+        CheckDeserializedHashes(txNoWitness, stripped);
+        BOOST_CHECK(txNoWitness.GetHash() == ref.GetHash());
+    }
+
+    // An extended encoding whose witnesses are all empty hashes and sizes like the basic one.
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = COIN;
+    const CTransaction ref(mtx);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << ref;
+    std::vector<unsigned char> raw(ss.begin(), ss.end());
+    std::vector<unsigned char> extended(raw.begin(), raw.begin() + 4);
+    extended.push_back(0);
+    extended.push_back(1);
+    extended.insert(extended.end(), raw.begin() + 4, raw.end() - 4);
+    extended.insert(extended.end(), mtx.vin.size(), 0);
+    extended.insert(extended.end(), raw.end() - 4, raw.end());
+    CDataStream ssExtended(extended, SER_NETWORK, PROTOCOL_VERSION);
+    CTransaction tx(deserialize, ssExtended);
+    CheckDeserializedHashes(tx, ref);
+    BOOST_CHECK_EQUAL(tx.GetTotalSize(), raw.size());
+}
+
 //
 // Helper: create two dummy transactions, each with
 // two outputs.  The first has 11 and 50 CENT outputs
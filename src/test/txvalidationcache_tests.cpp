@@ -5,6 +5,7 @@
 #include "consensus/validation.h"
 #include "key.h"
 #include "validation.h"
+#include "validationinterface.h"
 #include "miner.h"
 #include "pubkey.h"
 #include "txmempool.h"
@@ -90,6 +91,120 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_package, TestChain100Setup)
+{
+    // A parent that pays no fee is only accepted together with a child that
+    // pays for both.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction parent;
+    parent.nVersion = 1;
+    parent.vin.resize(1);
+    parent.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    parent.vin[0].prevout.n = 0;
+    parent.vout.resize(1);
+    parent.vout[0].nValue = coinbaseTxns[0].vout[0].nValue;
+    parent.vout[0].scriptPubKey = scriptPubKey;
+
+    CMutableTransaction child;
+    child.nVersion = 1;
+    child.vin.resize(1);
+    child.vin[0].prevout.n = 0;
+    child.vout.resize(1);
+    child.vout[0].nValue = parent.vout[0].nValue - 10000;
+    child.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, parent, 0, SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT);
+    parent.vin[0].scriptSig << vchSig;
+
+    child.vin[0].prevout.hash = parent.GetHash();
+    vchSig.clear();
+    hash = SignatureHash(scriptPubKey, child, 0, SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT);
+    child.vin[0].scriptSig << vchSig;
+
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(parent), true, nullptr));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "min relay fee not met");
+
+    // Children must come after their parents
+    std::vector<CTransactionRef> package;
+    package.push_back(MakeTransactionRef(child));
+    package.push_back(MakeTransactionRef(parent));
+    bool fMissingInputs;
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-not-sorted");
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+
+    std::swap(package[0], package[1]);
+    state = CValidationState();
+    BOOST_CHECK(AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK(mempool.exists(parent.GetHash()));
+    BOOST_CHECK(mempool.exists(child.GetHash()));
+    mempool.clear();
+
+    // A package that does not pay enough as a whole is not accepted at all
+    package[1] = MakeTransactionRef(parent);
+    package.resize(1);
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package min relay fee not met");
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+
+    // Nor can an unrelated transaction pay for it
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CMutableTransaction unrelated;
+    unrelated.nVersion = 1;
+    unrelated.vin.resize(1);
+    unrelated.vin[0].prevout.hash = coinbaseTxns[1].GetHash();
+    unrelated.vin[0].prevout.n = 0;
+    unrelated.vout.resize(1);
+    unrelated.vout[0].nValue = coinbaseTxns[1].vout[0].nValue - 100000;
+    unrelated.vout[0].scriptPubKey = scriptPubKey;
+    vchSig.clear();
+    hash = SignatureHash(scriptPubKey, unrelated, 0, SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL | SIGHASH_FORKID | SIGHASH_FORKID_SHIFT);
+    unrelated.vin[0].scriptSig << vchSig;
+    package.push_back(MakeTransactionRef(unrelated));
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package min relay fee not met");
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+
+    // A package whose last transaction is invalid leaves no trace, not even
+    // a notification for the transactions before it
+    struct AddedCounter : public CValidationInterface {
+        int nAdded = 0;
+        void TransactionAddedToMempool(const CTransactionRef& ptx) override { nAdded++; }
+    } counter;
+    RegisterValidationInterface(&counter);
+    CMutableTransaction badChild(child);
+    badChild.vin[0].scriptSig = CScript() << OP_0;
+    package[0] = MakeTransactionRef(parent);
+    package[1] = MakeTransactionRef(badChild);
+    package.resize(2);
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK(state.IsInvalid());
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+    BOOST_CHECK_EQUAL(counter.nAdded, 0);
+
+    package[1] = MakeTransactionRef(child);
+    state = CValidationState();
+    BOOST_CHECK(AcceptPackageToMemoryPool(mempool, state, package, &fMissingInputs));
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+    BOOST_CHECK_EQUAL(counter.nAdded, 2);
+    UnregisterValidationInterface(&counter);
+    mempool.clear();
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
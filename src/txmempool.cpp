@@ -452,7 +452,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // Also assumes that if an entry is in setDescendants already, then all
 // in-mempool descendants of it are already in setDescendants as well, so that we
 // can save time by not iterating over those entries.
-void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
+void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants) const
 {
     setEntries stage;
     if (setDescendants.count(entryit) == 0) {
@@ -475,6 +475,110 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
     }
 }
 
+bool CTxMemPool::CalculateCluster(txiter entry, setEntries &setCluster, size_t nMaxCount) const
+{
+    std::vector<txiter> stage;
+    if (setCluster.insert(entry).second) {
+        stage.push_back(entry);
+    }
+    while (!stage.empty()) {
+        if (setCluster.size() > nMaxCount) {
+            return false;
+        }
+        txiter it = stage.back();
+        stage.pop_back();
+        for (const txiter &parentiter : GetMemPoolParents(it)) {
+            if (setCluster.insert(parentiter).second) {
+                stage.push_back(parentiter);
+            }
+        }
+        for (const txiter &childiter : GetMemPoolChildren(it)) {
+            if (setCluster.insert(childiter).second) {
+                stage.push_back(childiter);
+            }
+        }
+    }
+    return setCluster.size() <= nMaxCount;
+}
+
+void CTxMemPool::LinearizeCluster(const setEntries &setCluster, std::vector<TxChunk> &vChunks) const
+{
+    vChunks.clear();
+
+    // Ancestor counts only grow from parent to child, so ordering by them
+    // gives a topological order of the cluster.
+    std::vector<txiter> vTx(setCluster.begin(), setCluster.end());
+    std::stable_sort(vTx.begin(), vTx.end(), [](const txiter &a, const txiter &b) {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    });
+    const size_t nTx = vTx.size();
+    std::map<txiter, size_t, CompareIteratorByHash> mapIndex;
+    for (size_t i = 0; i < nTx; i++) {
+        mapIndex[vTx[i]] = i;
+    }
+
+    // In-cluster ancestors (including the transaction itself) of every
+    // transaction, along with the fees and sizes of those not yet linearized.
+    std::vector<std::vector<bool>> vAncestors(nTx, std::vector<bool>(nTx, false));
+    std::vector<CAmount> vModFees(nTx, 0);
+    std::vector<int64_t> vSize(nTx, 0);
+    for (size_t i = 0; i < nTx; i++) {
+        vAncestors[i][i] = true;
+        for (const txiter &parentiter : GetMemPoolParents(vTx[i])) {
+            const std::vector<bool> &vParent = vAncestors[mapIndex.at(parentiter)];
+            for (size_t j = 0; j < nTx; j++) {
+                if (vParent[j]) vAncestors[i][j] = true;
+            }
+        }
+        for (size_t j = 0; j < nTx; j++) {
+            if (vAncestors[i][j]) {
+                vModFees[i] += vTx[j]->GetModifiedFee();
+                vSize[i] += vTx[j]->GetTxSize();
+            }
+        }
+    }
+
+    std::vector<bool> vDone(nTx, false);
+    for (size_t nDone = 0; nDone < nTx; ) {
+        size_t best = nTx;
+        for (size_t i = 0; i < nTx; i++) {
+            if (vDone[i]) continue;
+            // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+            if (best == nTx || (double)vModFees[i] * vSize[best] > (double)vModFees[best] * vSize[i]) {
+                best = i;
+            }
+        }
+
+        TxChunk chunk;
+        for (size_t j = 0; j < nTx; j++) {
+            if (!vAncestors[best][j] || vDone[j]) continue;
+            chunk.vTx.push_back(vTx[j]);
+            chunk.nModFees += vTx[j]->GetModifiedFee();
+            chunk.nSize += vTx[j]->GetTxSize();
+            vDone[j] = true;
+            nDone++;
+            for (size_t i = 0; i < nTx; i++) {
+                if (!vDone[i] && vAncestors[i][j]) {
+                    vModFees[i] -= vTx[j]->GetModifiedFee();
+                    vSize[i] -= vTx[j]->GetTxSize();
+                }
+            }
+        }
+
+        // Merge with earlier chunks that pay a lower feerate, so that chunk
+        // feerates never increase along the linearization.
+        while (!vChunks.empty() && (double)chunk.nModFees * vChunks.back().nSize > (double)vChunks.back().nModFees * chunk.nSize) {
+            TxChunk &prev = vChunks.back();
+            prev.vTx.insert(prev.vTx.end(), chunk.vTx.begin(), chunk.vTx.end());
+            prev.nModFees += chunk.nModFees;
+            prev.nSize += chunk.nSize;
+            chunk = std::move(prev);
+            vChunks.pop_back();
+        }
+        vChunks.push_back(std::move(chunk));
+    }
+}
+
 void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -819,6 +923,28 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolInfo> CTxMemPool::infoSorted(const std::vector<uint256>& vHashes) const
+{
+    LOCK(cs);
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    iters.reserve(vHashes.size());
+    for (const uint256& hash : vHashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i != mapTx.end()) {
+            iters.push_back(i);
+        }
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+
+    std::vector<TxMempoolInfo> ret;
+    ret.reserve(iters.size());
+    for (auto it : iters) {
+        ret.push_back(GetInfo(it));
+    }
+
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -828,6 +954,45 @@ CTransactionRef CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+TxMempoolEntrySnapshot CTxMemPool::GetEntrySnapshot(const CTxMemPoolEntry& e) const
+{
+    AssertLockHeld(cs);
+    TxMempoolEntrySnapshot ret;
+    ret.txid = e.GetTx().GetHash();
+    ret.nTxSize = e.GetTxSize();
+    ret.nFee = e.GetFee();
+    ret.nModFee = e.GetModifiedFee();
+    ret.nTime = e.GetTime();
+    ret.nHeight = e.GetHeight();
+    ret.nCountWithDescendants = e.GetCountWithDescendants();
+    ret.nSizeWithDescendants = e.GetSizeWithDescendants();
+    ret.nModFeesWithDescendants = e.GetModFeesWithDescendants();
+    ret.nCountWithAncestors = e.GetCountWithAncestors();
+    ret.nSizeWithAncestors = e.GetSizeWithAncestors();
+    ret.nModFeesWithAncestors = e.GetModFeesWithAncestors();
+    for (const CTxIn& txin : e.GetTx().vin) {
+        if (exists(txin.prevout.hash))
+            ret.setDepends.insert(txin.prevout.hash);
+    }
+    return ret;
+}
+
+std::shared_ptr<const TxMempoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    LOCK(cs);
+    if (snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated)
+        return snapshot;
+
+    std::shared_ptr<TxMempoolSnapshot> newSnapshot = std::make_shared<TxMempoolSnapshot>();
+    newSnapshot->nTransactionsUpdated = nTransactionsUpdated;
+    newSnapshot->vEntries.reserve(mapTx.size());
+    for (const CTxMemPoolEntry& e : mapTx) {
+        newSnapshot->vEntries.push_back(GetEntrySnapshot(e));
+    }
+    snapshot = newSnapshot;
+    return snapshot;
+}
+
 TxMempoolInfo CTxMemPool::info(const uint256& hash) const
 {
     LOCK(cs);
@@ -1172,25 +1337,42 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining, const setEntries* psetProtected) {
     LOCK(cs);
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        txiter worstit = mapTx.project<0>(it);
+
+        // Rather than the whole descendant package of the worst entry, evict the
+        // lowest feerate chunk of its cluster, so that a low feerate child does not
+        // take a well-paying parent with it. Very large clusters fall back to the
+        // descendant package.
+        CFeeRate removed;
+        setEntries stage;
+        setEntries setCluster;
+        if (CalculateCluster(worstit, setCluster, MAX_CLUSTER_LINEARIZE_COUNT)) {
+            std::vector<TxChunk> vChunks;
+            LinearizeCluster(setCluster, vChunks);
+            removed = vChunks.back().GetFeeRate();
+            stage.insert(vChunks.back().vTx.begin(), vChunks.back().vTx.end());
+        } else {
+            removed = CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            CalculateDescendants(worstit, stage);
+        }
+        if (psetProtected && std::any_of(stage.begin(), stage.end(), [psetProtected](txiter iter) { return psetProtected->count(iter); }))
+            break;
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1215,6 +1397,32 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     }
 }
 
+bool CTxMemPool::HasRoomFor(size_t nUsage, const CFeeRate& feerate, size_t sizelimit) const {
+    LOCK(cs);
+
+    size_t nTotalUsage = DynamicMemoryUsage() + nUsage;
+    setEntries setEvicted;
+    indexed_transaction_set::index<descendant_score>::type::const_iterator it = mapTx.get<descendant_score>().begin();
+    for (; nTotalUsage > sizelimit; ++it) {
+        if (it == mapTx.get<descendant_score>().end())
+            return false;
+        txiter worstit = mapTx.project<0>(it);
+        if (setEvicted.count(worstit))
+            continue;
+        if (CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants()) >= feerate)
+            return false;
+        setEntries stage;
+        CalculateDescendants(worstit, stage);
+        for (txiter evictit : stage) {
+            if (!setEvicted.insert(evictit).second)
+                continue;
+            size_t nEntryUsage = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) + evictit->DynamicMemoryUsage();
+            nTotalUsage -= std::min(nTotalUsage, nEntryUsage);
+        }
+    }
+    return true;
+}
+
 bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLimit) const {
     LOCK(cs);
     auto it = mapTx.find(txid);
@@ -33,6 +33,9 @@ class CBlockIndex;
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Largest cluster that is linearized into chunks when trimming the mempool */
+static const size_t MAX_CLUSTER_LINEARIZE_COUNT = 100;
+
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -394,6 +397,41 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Copy of the statistics of a mempool entry and its package, which stays
+ * valid and unchanged after the entry leaves the mempool. It does not hold on
+ * to the transaction itself, so an old snapshot does not keep removed
+ * transactions alive outside of DynamicMemoryUsage().
+ */
+struct TxMempoolEntrySnapshot
+{
+    uint256 txid;
+    size_t nTxSize;
+    CAmount nFee;
+    CAmount nModFee;
+    int64_t nTime;
+    unsigned int nHeight;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    /** Parents of the transaction that were in the mempool */
+    std::set<uint256> setDepends;
+};
+
+/**
+ * Immutable view of all mempool entries at one point in time. Readers can
+ * iterate it without holding the mempool lock.
+ */
+struct TxMempoolSnapshot
+{
+    /** Value of GetTransactionsUpdated() the snapshot was taken at */
+    unsigned int nTransactionsUpdated;
+    std::vector<TxMempoolEntrySnapshot> vEntries;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -507,6 +545,8 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    mutable std::shared_ptr<const TxMempoolSnapshot> snapshot; //!< last view returned by GetSnapshot()
+
     void trackPackageRemoved(const CFeeRate& rate);
 
 public:
@@ -560,6 +600,17 @@ public:
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
+
+    /** Transactions from one cluster that are best mined or evicted together,
+     *  in an order that is valid for a block */
+    struct TxChunk {
+        std::vector<txiter> vTx;
+        CAmount nModFees;
+        int64_t nSize;
+
+        TxChunk() : nModFees(0), nSize(0) {}
+        CFeeRate GetFeeRate() const { return CFeeRate(nModFees, nSize); }
+    };
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
@@ -682,7 +733,21 @@ public:
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries &setDescendants);
+    void CalculateDescendants(txiter it, setEntries &setDescendants) const;
+
+    /** Populate setCluster with all transactions connected to entry through
+     *  in-mempool parents and children, including entry itself.
+     *  Returns false as soon as the cluster grows beyond nMaxCount, in which
+     *  case setCluster only holds part of it. */
+    bool CalculateCluster(txiter entry, setEntries &setCluster, size_t nMaxCount) const;
+
+    /** Split a cluster into chunks of non-increasing feerate. Transactions are
+     *  linearized by repeatedly taking the remaining in-cluster ancestor set
+     *  with the highest feerate, after which neighbouring sets are merged
+     *  wherever the later one pays a higher feerate. The last chunk is the
+     *  cheapest part of the cluster and has no descendants outside itself.
+     *  Runs in time quadratic in the size of the cluster. */
+    void LinearizeCluster(const setEntries &setCluster, std::vector<TxChunk> &vChunks) const;
 
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
@@ -693,10 +758,22 @@ public:
     CFeeRate GetMinFee(size_t sizelimit) const;
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+      *  Each step starts from the entry with the lowest descendant score and
+      *  evicts the lowest feerate chunk of its cluster, or the entry with all its
+      *  descendants if the cluster is larger than MAX_CLUSTER_LINEARIZE_COUNT.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
+      *  If the next step would evict an entry in psetProtected, trimming stops
+      *  there, above sizelimit.
+      */
+    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=nullptr, const setEntries* psetProtected=nullptr);
+
+    /** Estimate whether new entries using nUsage bytes, none of which pays less
+      *  than feerate, would survive TrimToSize(sizelimit): that is, whether the
+      *  entries it would evict first free enough memory. Descendant packages
+      *  stand in for cluster chunks, so this is not exact.
       */
-    void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining=nullptr);
+    bool HasRoomFor(size_t nUsage, const CFeeRate& feerate, size_t sizelimit) const;
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -725,6 +802,14 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Copy an entry along with its in-mempool parents (cs must be held) */
+    TxMempoolEntrySnapshot GetEntrySnapshot(const CTxMemPoolEntry& entry) const;
+    /** Return a view of all entries that can be iterated without holding cs.
+     *  Entries are only copied again once the mempool has changed, so
+     *  frequent readers share the same view between changes. */
+    std::shared_ptr<const TxMempoolSnapshot> GetSnapshot() const;
+    /** Info for those of the given transactions still in the pool, sorted by depth and score like infoAll(). */
+    std::vector<TxMempoolInfo> infoSorted(const std::vector<uint256>& vHashes) const;
 
     size_t DynamicMemoryUsage() const;
 
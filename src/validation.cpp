@@ -269,7 +269,7 @@ bool TestLockPointValidity(const LockPoints* lp)
     return true;
 }
 
-bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool useExistingLockPoints)
+bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool useExistingLockPoints, const CCoinsView* pcoinsview)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(mempool.cs);
@@ -294,12 +294,13 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
     else {
         // pcoinsTip contains the UTXO set for chainActive.Tip()
         CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        const CCoinsView& viewCoins = pcoinsview ? *pcoinsview : viewMemPool;
         std::vector<int> prevheights;
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
             Coin coin;
-            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+            if (!viewCoins.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
             if (coin.nHeight == MEMPOOL_HEIGHT) {
@@ -425,10 +426,96 @@ void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool f
     LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 }
 
+/**
+ * Members of a package that passed AcceptToMemoryPoolWorker but are not in the
+ * mempool yet. view holds the coins they create and spend, and later members
+ * count them as unconfirmed ancestors, so that the whole package is validated
+ * before any of it is added.
+ */
+struct PackageStage {
+    explicit PackageStage(CCoinsView* pbase) : view(pbase) {}
+
+    CCoinsViewCache view;
+    std::vector<CTxMemPoolEntry> vEntries;
+    std::map<uint256, size_t> mapIndex;
+    // In-mempool and staged ancestors of each entry
+    std::vector<CTxMemPool::setEntries> vPoolAncestors;
+    std::vector<std::set<size_t>> vStagedAncestors;
+    // Count and size of the staged descendants of each ancestor, itself included
+    std::vector<std::pair<uint64_t, uint64_t>> vStagedDescendants;
+    std::map<CTxMemPool::txiter, std::pair<uint64_t, uint64_t>, CTxMemPool::CompareIteratorByHash> mapPoolDescendants;
+
+    const CTransaction* GetTx(const uint256& hash) const
+    {
+        auto it = mapIndex.find(hash);
+        return it == mapIndex.end() ? nullptr : &vEntries[it->second].GetTx();
+    }
+
+    // Like CalculateMemPoolAncestors, counting staged ancestors and descendants too
+    bool CalculateAncestors(const CTxMemPool& pool, const CTxMemPoolEntry& entry, CTxMemPool::setEntries& setAncestors, std::set<size_t>& setStaged,
+                            uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString) const
+    {
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        pool.CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString);
+        for (const CTxIn& txin : entry.GetTx().vin) {
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && setStaged.insert(it->second).second) {
+                setStaged.insert(vStagedAncestors[it->second].begin(), vStagedAncestors[it->second].end());
+            }
+        }
+        uint64_t nSizeWithAncestors = entry.GetTxSize();
+        for (size_t i : setStaged) {
+            setAncestors.insert(vPoolAncestors[i].begin(), vPoolAncestors[i].end());
+            nSizeWithAncestors += vEntries[i].GetTxSize();
+            if (vStagedDescendants[i].first + 1 > limitDescendantCount || vStagedDescendants[i].second + entry.GetTxSize() > limitDescendantSize) {
+                errString = strprintf("too many descendants for tx %s [limit: %u]", vEntries[i].GetTx().GetHash().ToString(), limitDescendantCount);
+                return false;
+            }
+        }
+        for (CTxMemPool::txiter it : setAncestors) {
+            nSizeWithAncestors += it->GetTxSize();
+            auto itStaged = mapPoolDescendants.find(it);
+            uint64_t nCount = it->GetCountWithDescendants() + (itStaged == mapPoolDescendants.end() ? 0 : itStaged->second.first);
+            uint64_t nSize = it->GetSizeWithDescendants() + (itStaged == mapPoolDescendants.end() ? 0 : itStaged->second.second);
+            if (nCount + 1 > limitDescendantCount || nSize + entry.GetTxSize() > limitDescendantSize) {
+                errString = strprintf("too many descendants for tx %s [limit: %u]", it->GetTx().GetHash().ToString(), limitDescendantCount);
+                return false;
+            }
+        }
+        if (setAncestors.size() + setStaged.size() + 1 > limitAncestorCount) {
+            errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
+            return false;
+        }
+        if (nSizeWithAncestors > limitAncestorSize) {
+            errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
+            return false;
+        }
+        return true;
+    }
+
+    void Add(const CTxMemPoolEntry& entry, const CTxMemPool::setEntries& setAncestors, const std::set<size_t>& setStaged)
+    {
+        for (CTxMemPool::txiter it : setAncestors) {
+            mapPoolDescendants[it].first++;
+            mapPoolDescendants[it].second += entry.GetTxSize();
+        }
+        for (size_t i : setStaged) {
+            vStagedDescendants[i].first++;
+            vStagedDescendants[i].second += entry.GetTxSize();
+        }
+        mapIndex[entry.GetTx().GetHash()] = vEntries.size();
+        vEntries.push_back(entry);
+        vPoolAncestors.push_back(setAncestors);
+        vStagedAncestors.push_back(setStaged);
+        vStagedDescendants.push_back(std::make_pair(1, entry.GetTxSize()));
+        UpdateCoins(entry.GetTx(), view, MEMPOOL_HEIGHT);
+    }
+};
+
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
 // were somehow broken and returning the wrong scriptPubKeys
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, CTxMemPool& pool,
-                 unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata) {
+                 unsigned int flags, bool cacheSigStore, PrecomputedTransactionData& txdata, const PackageStage* pstage = nullptr) {
     AssertLockHeld(cs_main);
 
     // pool.cs should be locked already, but go ahead and re-take the lock here
@@ -447,7 +534,11 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
         if (coin.IsSpent()) return false;
 
         const CTransactionRef& txFrom = pool.get(txin.prevout.hash);
-        if (txFrom) {
+        const CTransaction* ptxStaged = pstage ? pstage->GetTx(txin.prevout.hash) : nullptr;
+        if (ptxStaged) {
+            assert(ptxStaged->vout.size() > txin.prevout.n);
+            assert(ptxStaged->vout[txin.prevout.n] == coin.out);
+        } else if (txFrom) {
             assert(txFrom->GetHash() == txin.prevout.hash);
             assert(txFrom->vout.size() > txin.prevout.n);
             assert(txFrom->vout[txin.prevout.n] == coin.out);
@@ -461,9 +552,45 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+// CheckInputs for mempool acceptance which spreads the script checks of a
+// transaction with several inputs over the script verification threads, so
+// that large transactions do not hold cs_main for the time it takes to check
+// all of their signatures on one core. Valid signatures end up in the
+// signature cache as with a serial check. On failure the inputs are checked
+// again serially, so that state is filled in exactly as CheckInputs would.
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
+                 unsigned int flags, PrecomputedTransactionData& txdata) {
+    AssertLockHeld(cs_main);
+
+    if (fScriptChecks && nScriptCheckThreads && tx.vin.size() > 1) {
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks))
+            return false;
+        // cs_main is held, so ConnectBlock cannot be using the queue
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    }
+
+    return CheckInputs(tx, state, view, fScriptChecks, flags, true, false, txdata);
+}
+
+static unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams)
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache,
+                              bool fScriptChecks, PackageStage* pstage = nullptr)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -555,7 +682,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         {
         LOCK(pool.cs);
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-        view.SetBackend(viewMemPool);
+        if (pstage)
+            view.SetBackend(pstage->view);
+        else
+            view.SetBackend(viewMemPool);
 
         // do all inputs exist?
         for (const CTxIn txin : tx.vin) {
@@ -591,7 +721,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // be mined yet.
         // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
         // CoinsViewCache instead of create its own
-        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp, false, pstage ? &view : nullptr))
             return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
         }
 
@@ -636,12 +766,13 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 strprintf("%d", nSigOpsCost));
 
         CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
+        // Transactions in a package only have to meet the fee floors as a package
+        if (!pstage && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
         }
 
         // No transactions are allowed below minRelayTxFee except from disconnected blocks
-        if (fLimitFree && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
+        if (fLimitFree && !pstage && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
         }
 
@@ -657,7 +788,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
         size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
         std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+        // Package members may also have ancestors that are only staged
+        std::set<size_t> setStagedAncestors;
+        if (pstage ? !pstage->CalculateAncestors(pool, entry, setAncestors, setStagedAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)
+                   : !pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
             return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
         }
 
@@ -805,15 +939,14 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!chainparams.RequireStandard()) {
-            scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+        // Scripts are only skipped when reloading transactions that this node
+        // already verified under the same flags (see LoadMempool).
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsParallel(tx, state, view, fScriptChecks, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -842,7 +975,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // invalid blocks (using TestBlockValidity), however allowing such
         // transactions into the mempool can be exploited as a DoS attack.
         unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata))
+        if (fScriptChecks && !CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata, pstage))
         {
             // If we're using promiscuousmempoolflags, we may hit this normally
             // Check if current block has some flags that scriptVerifyFlags
@@ -860,6 +993,13 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
+        // Package members are only added once the whole package is valid
+        if (pstage) {
+            assert(allConflicting.empty());
+            pstage->Add(entry, setAncestors, setStagedAncestors);
+            return true;
+        }
+
         // Remove conflicting transactions from the mempool
         for (const CTxMemPool::txiter it : allConflicting)
         {
@@ -905,10 +1045,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee, bool fScriptChecks = true)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
+    bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache, fScriptChecks);
     if (!res) {
         for (const COutPoint& hashTx : coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
@@ -927,6 +1067,171 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee);
 }
 
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::vector<CTransactionRef>& package,
+                               bool* pfMissingInputs, const CAmount nAbsurdFee, uint256* phashFailed)
+{
+    const CChainParams& chainparams = Params();
+    AssertLockHeld(cs_main);
+    // Holding pool.cs throughout means nobody sees a partially accepted package
+    LOCK(pool.cs);
+    if (pfMissingInputs)
+        *pfMissingInputs = false;
+
+    if (package.empty() || package.size() > MAX_PACKAGE_COUNT)
+        return state.Invalid(false, REJECT_INVALID, "package-bad-size");
+
+    // Check the package is topologically sorted, and work out the fees and
+    // size of each transaction with it seeing the outputs of the ones before it
+    CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+    CCoinsViewCache view(&viewMemPool);
+    std::map<uint256, size_t> mapPackageIndex;
+    std::set<COutPoint> setPackageSpends;
+    // Transactions that spend each other's outputs share a component; fees
+    // are only pooled within a component
+    std::vector<size_t> vComponent(package.size());
+    std::vector<CAmount> vModifiedFees(package.size(), 0);
+    std::vector<int64_t> vSize(package.size(), 0);
+    auto FindComponent = [&vComponent](size_t i) {
+        while (vComponent[i] != i)
+            i = vComponent[i] = vComponent[vComponent[i]];
+        return i;
+    };
+    for (size_t i = 0; i < package.size(); i++) {
+        const CTransaction& tx = *package[i];
+        const uint256& hash = tx.GetHash();
+        if (phashFailed)
+            *phashFailed = hash;
+        vComponent[i] = i;
+        if (!mapPackageIndex.emplace(hash, i).second)
+            return state.Invalid(false, REJECT_INVALID, "package-duplicate-tx");
+        if (pool.exists(hash)) {
+            // Already accepted on its own; it no longer counts towards any package feerate
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+            vComponent[i] = package.size();
+            continue;
+        }
+        for (const CTxIn& txin : tx.vin) {
+            // A conflict could cause a replacement, which could not be rolled back
+            if (pool.mapNextTx.count(txin.prevout))
+                return state.Invalid(false, REJECT_DUPLICATE, "package-mempool-conflict");
+            if (!setPackageSpends.insert(txin.prevout).second)
+                return state.Invalid(false, REJECT_INVALID, "package-conflict");
+            if (!view.HaveCoin(txin.prevout)) {
+                for (const CTransactionRef& ptxLater : package) {
+                    if (ptxLater->GetHash() == txin.prevout.hash)
+                        return state.Invalid(false, REJECT_INVALID, "package-not-sorted");
+                }
+                if (pfMissingInputs)
+                    *pfMissingInputs = true;
+                return false;
+            }
+            auto itParent = mapPackageIndex.find(txin.prevout.hash);
+            if (itParent != mapPackageIndex.end() && vComponent[itParent->second] != package.size())
+                vComponent[FindComponent(itParent->second)] = FindComponent(i);
+        }
+        if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view)))
+            return false;
+        vModifiedFees[i] = view.GetValueIn(tx) - tx.GetValueOut();
+        pool.ApplyDelta(hash, vModifiedFees[i]);
+        vSize[i] = GetVirtualTransactionSize(tx);
+        AddCoins(view, tx, MEMPOOL_HEIGHT);
+    }
+    if (phashFailed)
+        phashFailed->SetNull();
+
+    std::map<size_t, std::pair<CAmount, int64_t>> mapComponentFees;
+    for (size_t i = 0; i < package.size(); i++) {
+        if (vComponent[i] == package.size())
+            continue;
+        std::pair<CAmount, int64_t>& component = mapComponentFees[FindComponent(i)];
+        component.first += vModifiedFees[i];
+        component.second += vSize[i];
+    }
+    CFeeRate minComponentFeeRate(MAX_MONEY);
+    for (const auto& component : mapComponentFees) {
+        CAmount nModifiedFees = component.second.first;
+        int64_t nSize = component.second.second;
+        CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "package mempool min fee not met", false, strprintf("%d < %d", nModifiedFees, mempoolRejectFee));
+        }
+        if (nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "package min relay fee not met");
+        }
+        minComponentFeeRate = std::min(minComponentFeeRate, CFeeRate(nModifiedFees, nSize));
+    }
+
+    // Validate the whole package against a staged view before any of it
+    // goes into the mempool
+    PackageStage stage(&viewMemPool);
+    std::vector<COutPoint> coins_to_uncache;
+    bool fAccepted = true;
+    for (const CTransactionRef& ptx : package) {
+        if (pool.exists(ptx->GetHash()))
+            continue;
+        if (!AcceptToMemoryPoolWorker(chainparams, pool, state, ptx, true, pfMissingInputs, GetTime(), nullptr, true, nAbsurdFee, coins_to_uncache, true, &stage)) {
+            if (phashFailed)
+                *phashFailed = ptx->GetHash();
+            fAccepted = false;
+            break;
+        }
+    }
+
+    // Decide whether the package fits before anything goes into the mempool,
+    // so that a rejected package never evicts other transactions
+    const size_t nMaxMempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    if (fAccepted) {
+        size_t nPackageUsage = 0;
+        for (const CTxMemPoolEntry& entry : stage.vEntries)
+            nPackageUsage += memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) + entry.DynamicMemoryUsage();
+        if (!pool.HasRoomFor(nPackageUsage, minComponentFeeRate, nMaxMempool)) {
+            fAccepted = false;
+            state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
+    }
+
+    if (fAccepted) {
+        // Add the transactions in order, without trimming the mempool in
+        // between so that low fee parents are not evicted before their children
+        const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        CTxMemPool::setEntries setPackage;
+        for (const CTxMemPoolEntry& entry : stage.vEntries) {
+            CTxMemPool::setEntries setAncestors;
+            std::string dummy;
+            pool.CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+            if (fAddressIndex) {
+                CCoinsViewCache viewIndex(&viewMemPool);
+                pool.addAddressIndex(entry, viewIndex);
+                pool.addSpentIndex(entry, viewIndex);
+            }
+            // Package members depend on each other's fees, so they do not count for fee estimation
+            pool.addUnchecked(entry.GetTx().GetHash(), entry, setAncestors, false);
+            setPackage.insert(pool.mapTx.find(entry.GetTx().GetHash()));
+        }
+
+        // The package is committed. HasRoomFor is only an estimate, so if
+        // trimming would reach the package it stops there instead. Expiry is
+        // left to the next acceptance, as it could take a package member
+        // with an old ancestor.
+        std::vector<COutPoint> vNoSpendsRemaining;
+        pool.TrimToSize(nMaxMempool, &vNoSpendsRemaining, &setPackage);
+        for (const COutPoint& removed : vNoSpendsRemaining)
+            pcoinsTip->Uncache(removed);
+    }
+
+    if (fAccepted) {
+        for (const CTxMemPoolEntry& entry : stage.vEntries)
+            GetMainSignals().TransactionAddedToMempool(entry.GetSharedTx());
+    } else {
+        for (const COutPoint& outpoint : coins_to_uncache)
+            pcoinsTip->Uncache(outpoint);
+    }
+
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return fAccepted;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1277,6 +1582,12 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (pblock) {
+        if (!CheckBlockSignature(*pblock))
+            return false;
+        error = SCRIPT_ERR_OK;
+        return true;
+    }
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
     return VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata), &error);
@@ -1302,6 +1613,32 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void DumpScriptExecutionCache()
+{
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    {
+        LOCK(cs_main);
+        nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+    }
+    DumpCacheFile("scriptcache.dat", nonce, vEntries);
+}
+
+bool LoadScriptExecutionCache()
+{
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    if (!LoadCacheFile("scriptcache.dat", nonce, vEntries)) {
+        return false;
+    }
+    LOCK(cs_main);
+    scriptExecutionCacheNonce = nonce;
+    for (uint256& entry : vEntries)
+        scriptExecutionCache.insert(entry);
+    return true;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1705,8 +2042,6 @@ void static FlushBlockFile(bool fFinalize = false)
 
 static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
     scriptcheckqueue.Thread();
@@ -1811,11 +2146,11 @@ static bool UpdateHashProof(const CBlock& block, CValidationState& state, const
     if (pindex->nHeight < Params().GetConsensus().fidShiftHeight) return true;
     if (pindex->IsProofOfStake()) {
         auto& prevout = block.vtx[1]->vin[0].prevout;
-        if (!view.HaveCoin(prevout)) {
+        const Coin& coin = view.AccessCoin(prevout);
+        if (coin.IsSpent()) {
             LogPrint(BCLog::STAKE, "%s: inputs missing/spent\n", __func__);
             return false;
         }
-        auto coin = view.AccessCoin(prevout);
         auto prevTime = chainActive[coin.nHeight]->nTime;
         pindex->hashProof = GetStakeHashProof(prevout, block.nTime, prevTime, pindex->bnStakeModifierV2);
     } else {
@@ -1824,6 +2159,38 @@ static bool UpdateHashProof(const CBlock& block, CValidationState& state, const
     return true;
 }
 
+/**
+ * Whether pindex is covered by -assumevalid, so that its input scripts need
+ * not be checked.
+ */
+static bool IsAssumedValid(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    if (hashAssumeValid.IsNull())
+        return false;
+    // We've been configured with the hash of a block which has been externally verified to have a valid history.
+    // A suitable default value is included with the software and updated from time to time.  Because validity
+    //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+    // This setting doesn't force the selection of any particular chain but makes validating some faster by
+    //  effectively caching the result of part of the verification.
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+    if (it->second->GetAncestor(pindex->nHeight) != pindex ||
+        pindexBestHeader->GetAncestor(pindex->nHeight) != pindex ||
+        pindexBestHeader->nChainWork < nMinimumChainWork)
+        return false;
+    // This block is a member of the assumed verified chain and an ancestor of the best header.
+    // The equivalent time check discourages hash power from extorting the network via DOS attack
+    //  into accepting an invalid block through telling users they must manually set assumevalid.
+    //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+    //  it hard to hide the implication of the demand.  This also avoids having release candidates
+    //  that are hardly doing any signature verification at all in testing without having to
+    //  artificially set the default assumed verified block further back.
+    // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+    //  least as good as the expected chain.
+    return GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) > 60 * 60 * 24 * 7 * 2;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -1851,10 +2218,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     if (pindex->nHeight > chainparams.GetConsensus().posHeight) {
         if (block.IsProofOfStake()) {
-            // Check proof-of-stake block signature
-            if (!CheckBlockSignature(block))
-             return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", false, "bad proof-of-stake block signature");
-        
+            // The proof-of-stake block signature is checked below, together
+            // with the scripts of the block's inputs.
             if (pindex->nHeight % 10) {
                 return state.DoS(1, error("ConnectBlock(): expected PoW block on height %d", pindex->nHeight),
                     REJECT_INVALID, "bad-expected-pos");
@@ -1887,31 +2252,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         return true;
     }
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= nMinimumChainWork) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hash power from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
+    bool fScriptChecks = !IsAssumedValid(pindex, chainparams.GetConsensus());
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
@@ -1967,7 +2308,25 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Check proof-of-stake block signature, unless ProcessNewBlock already did
+    // (blocks loaded from disk or built locally were not checked yet).
+    // It is not covered by the block hash, so unlike the input scripts it is
+    // checked for blocks covered by -assumevalid too. When script check
+    // threads are available it is verified on them while the inputs are
+    // being connected, even if the input scripts themselves are skipped.
+    bool fCheckBlockSig = pindex->nHeight > chainparams.GetConsensus().posHeight && block.IsProofOfStake() &&
+        !(pindex->nFlags & CBlockIndex::BLOCK_SIGNATURE_VALID);
+    bool fBlockSigQueued = fCheckBlockSig && nScriptCheckThreads;
+
+    CCheckQueueControl<CScriptCheck> control((fScriptChecks || fBlockSigQueued) && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+
+    if (fBlockSigQueued) {
+        std::vector<CScriptCheck> vBlockSig;
+        vBlockSig.emplace_back(block);
+        control.Add(vBlockSig);
+    } else if (fCheckBlockSig && !CheckBlockSignature(block)) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", false, "bad proof-of-stake block signature");
+    }
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2068,7 +2427,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return state.DoS(100, error("ConnectBlock(): too many sigops"),
                              REJECT_INVALID, "bad-blk-sigops");
 
-        txdata.emplace_back(tx);
+        // The signature hash data is filled in by the script checks that
+        // need it, on the script check threads.
+        txdata.emplace_back();
         if (!tx.IsCoinBase())
         {
             nFees += view.GetValueIn(tx)-tx.GetValueOut();
@@ -2154,8 +2515,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             return state.DoS(100, error("%s: coinbase has no premine", __func__), REJECT_INVALID, "bad-cb-no-premine");
     }
 
-    if (!control.Wait())
+    if (!control.Wait()) {
+        // Report a bad block signature as such rather than as a script failure
+        if (fBlockSigQueued && !CheckBlockSignature(block))
+            return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", false, "bad proof-of-stake block signature");
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    }
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -3174,6 +3539,41 @@ static bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
     return true;
 }
 
+/**
+ * Closure representing the context-free checks of one block transaction:
+ * CheckTransaction, and its legacy sigop count, which is stored in *pnSigOps.
+ */
+class CBlockTxCheck
+{
+private:
+    const CTransaction *ptx;
+    unsigned int *pnSigOps;
+
+public:
+    CBlockTxCheck(): ptx(nullptr), pnSigOps(nullptr) {}
+    CBlockTxCheck(const CTransaction& tx, unsigned int *pnSigOpsIn) : ptx(&tx), pnSigOps(pnSigOpsIn) {}
+
+    bool operator()() {
+        CValidationState state;
+        if (!CheckTransaction(*ptx, state, false))
+            return false;
+        *pnSigOps = GetLegacySigOpCount(*ptx);
+        return true;
+    }
+
+    void swap(CBlockTxCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+static CCheckQueue<CBlockTxCheck> blockcheckqueue(16);
+
+void ThreadBlockCheck() {
+    RenameThread("bitcoin-blockch");
+    blockcheckqueue.Thread();
+}
+
 static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
 {
     // Check proof of work matches claimed amount
@@ -3229,22 +3629,42 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
             return state.DoS(100, false, REJECT_INVALID, "bad-cs-multiple", false, "more than one coinstake");
     } 
 
-    // Check transactions
-    for (const auto& tx : block.vtx)
-        if (!CheckTransaction(*tx, state, false))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    // Check transactions. Large blocks are spread over the block check
+    // threads; if any transaction fails there, the serial loop below runs to
+    // fill in state for the first failing one.
+    std::vector<unsigned int> vSigOps(block.vtx.size());
+    bool fTxsChecked = false;
+    if (nScriptCheckThreads && block.vtx.size() >= MIN_BLOCK_TXS_FOR_PARALLEL_CHECK) {
+        std::vector<CBlockTxCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++)
+            vChecks.emplace_back(*block.vtx[i], &vSigOps[i]);
+        CCheckQueueControl<CBlockTxCheck> control(&blockcheckqueue);
+        control.Add(vChecks);
+        fTxsChecked = control.Wait();
+    }
+    if (!fTxsChecked) {
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            if (!CheckTransaction(tx, state, false))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+            vSigOps[i] = GetLegacySigOpCount(tx);
+        }
+    }
 
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
+    for (unsigned int nTxSigOps : vSigOps)
     {
-        nSigOps += GetLegacySigOpCount(*tx);
+        nSigOps += nTxSigOps;
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
 
-    if (fCheckPOW && fCheckMerkleRoot)
+    if (fCheckPOW && fCheckMerkleRoot) {
+        block.hashChecked = block.CBlockHeader::GetHash();
         block.fChecked = true;
+    }
 
     return true;
 }
@@ -3338,6 +3758,23 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationSta
             return state.DoS(100, error("%s: forked chain older than last checkpoint (height %d)", __func__, nHeight), REJECT_CHECKPOINT, "bad-fork-prior-to-checkpoint");
     }
 
+    // Check the proof-of-stake schedule, so that headers of chains which
+    // ConnectBlock would reject are not accepted and their blocks not
+    // downloaded. Use the version bits, as the block body may not be known.
+    if (nHeight <= consensusParams.posHeight) {
+        if (block.IsPoS())
+            return state.DoS(100, false, REJECT_INVALID, "bad-blk-early-pos", false, "too early PoS");
+    } else if (nHeight % 10) {
+        // Only proof-of-work blocks may go here, whatever their version
+        if (block.IsPoS() && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+            return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
+    } else {
+        if (!block.IsPoS())
+            return state.DoS(1, false, REJECT_INVALID, "bad-expected-pos", false, strprintf("expected PoS block on height %d", nHeight));
+        if (!IsCanonicalBlockSignature(block))
+            return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", true, "non-canonical proof-of-stake block signature");
+    }
+
     // Check timestamp against prev
     if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast())
         return state.Invalid(false, REJECT_INVALID, "time-too-old", "block's timestamp is too early");
@@ -3518,8 +3955,11 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
-/** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
-static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
+/**
+ * Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk.
+ * fSignatureChecked is set when the caller already verified the proof-of-stake block signature.
+ */
+static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fSignatureChecked = false)
 {
     const CBlock& block = *pblock;
 
@@ -3581,6 +4021,13 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
         return error("%s: %s", __func__, FormatStateMessage(state));
     }
 
+    // Remember a proof-of-stake block signature checked by the caller, so
+    // ConnectBlock does not verify it again.
+    if (fSignatureChecked && block.IsProofOfStake()) {
+        pindex->nFlags |= CBlockIndex::BLOCK_SIGNATURE_VALID;
+        setDirtyBlockIndex.insert(pindex);
+    }
+
     // Header is valid/has work, merkle tree and segwit merkle tree are good...RELAY NOW
     // (but if it does not build on our best tip, let the SendMessages loop relay it)
     if (!IsInitialBlockDownload() && chainActive.Tip() == pindex->pprev)
@@ -3620,12 +4067,24 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
         bool ret = CheckBlock(*pblock, state, chainparams.GetConsensus());
-        
+
+        // The proof-of-stake block signature does not depend on the chain, so
+        // check it here before cs_main is taken, also for blocks covered by
+        // -assumevalid. It is not covered by the block hash, so a bad one only
+        // means this copy of the block is corrupt.
+        bool fSignatureChecked = false;
+        if (ret && pblock->IsProofOfStake()) {
+            if (CheckBlockSignature(*pblock))
+                fSignatureChecked = true;
+            else
+                ret = state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", true, "bad proof-of-stake block signature");
+        }
+
         LOCK(cs_main);
 
         if (ret) {
             // Store to disk
-            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock);  
+            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, nullptr, fNewBlock, fSignatureChecked);
         }
         CheckBlockIndex(chainparams.GetConsensus());
         if (!ret) {
@@ -4720,11 +5179,12 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
 
 bool LoadMempool(void)
 {
     const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMicros();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
     FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
@@ -4741,9 +5201,20 @@ bool LoadMempool(void)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+        // Version 2 dumps record the client version and script flags the
+        // transactions were verified with. If neither changed, their scripts
+        // do not need to be executed again. Blocks are still checked in full.
+        bool fScriptChecks = true;
+        if (version >= 2) {
+            int nDumpClientVersion;
+            unsigned int nDumpScriptFlags;
+            file >> nDumpClientVersion;
+            file >> nDumpScriptFlags;
+            fScriptChecks = nDumpClientVersion != CLIENT_VERSION || nDumpScriptFlags != GetMempoolScriptVerifyFlags(chainparams);
+        }
         uint64_t num;
         file >> num;
         while (num--) {
@@ -4761,7 +5232,7 @@ bool LoadMempool(void)
             CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, true, nullptr, nTime, nullptr, false, 0);
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, true, nullptr, nTime, nullptr, false, 0, fScriptChecks);
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -4784,12 +5255,16 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired (%.2fs)\n", count, failed, skipped, (GetTimeMicros() - nStart) * 0.000001);
     return true;
 }
 
 void DumpMempool(void)
 {
+    // Periodic dumps run on the scheduler thread, the final one at shutdown
+    static CCriticalSection cs_dumpmempool;
+    LOCK(cs_dumpmempool);
+
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
@@ -4815,6 +5290,8 @@ void DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << (int)CLIENT_VERSION;
+        file << GetMempoolScriptVerifyFlags(Params());
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
@@ -414,8 +414,16 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Blocks with at least this many transactions have them checked on the block check threads */
+static const unsigned int MIN_BLOCK_TXS_FOR_PARALLEL_CHECK = 64;
+/** Number of blocks that can be requested at any given time from a single peer. This is also the
+ *  initial value of the adaptive per-peer block download window. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds of the adaptive per-peer block download window. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 32;
+/** Request-to-receipt time (in microseconds) under which a block download grows the peer's window. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_LATENCY = 2 * 1000000;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -429,7 +437,8 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). The number of blocks in flight per peer within this window is adaptive, see
+ *  MIN_BLOCKS_IN_TRANSIT_PER_PEER and MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -447,6 +456,10 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Minimum time in microseconds between rebuilds of the relay order shared by all peers. */
+static const int64_t INVENTORY_RELAY_ORDER_INTERVAL = 1000000;
+/** Time in microseconds a queued transaction is kept in the shared relay order. */
+static const int64_t INVENTORY_RELAY_ORDER_EXPIRY = 2 * 60 * 1000000;
 /** Average delay between feefilter broadcasts in seconds. */
 static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
@@ -467,6 +480,10 @@ static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
+/** Interval in seconds between periodic dumps of the mempool to disk */
+static const int64_t DUMP_MEMPOOL_INTERVAL = 15 * 60;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -605,6 +622,9 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block transaction checking thread. One is started
+ *  next to each script checking thread. */
+void ThreadBlockCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -641,6 +661,20 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced = nullptr,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/** Maximum number of transactions in a package accepted with AcceptPackageToMemoryPool */
+static const unsigned int MAX_PACKAGE_COUNT = 25;
+
+/** (try to) add a topologically sorted package of transactions to the memory pool
+ * at once. The mempool fee floors are checked against the feerate of each set
+ * of package transactions connected by spends, so a child can pay for a parent
+ * that would be rejected on its own, but not for an unrelated transaction. The
+ * whole package is validated before any of it is added, and either all
+ * transactions are accepted or none are. Transactions
+ * that conflict with the mempool are not accepted. If a transaction caused
+ * the failure, *phashFailed is set to its hash. **/
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::vector<CTransactionRef>& package,
+                               bool* pfMissingInputs, const CAmount nAbsurdFee=0, uint256* phashFailed = nullptr);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -681,14 +715,17 @@ bool TestLockPointValidity(const LockPoints* lp);
  * of the block needed for calculation or skips the calculation and uses the LockPoints
  * passed in for evaluation.
  * The LockPoints should not be considered valid if CheckSequenceLocks returns false.
+ * The inputs are looked up in the mempool and pcoinsTip, or in pcoinsview if given.
  *
  * See consensus/consensus.h for flag definitions.
  */
-bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false);
+bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false, const CCoinsView* pcoinsview = nullptr);
 
 /**
  * Closure representing one script verification
  * Note that this stores references to the spending transaction 
+ * A check built from a block instead verifies that block's proof-of-stake
+ * signature, so it can run on the script check threads next to the inputs.
  */
 class CScriptCheck
 {
@@ -701,12 +738,15 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    const CBlock *pblock;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), pblock(nullptr) {}
     CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(scriptPubKeyIn), amount(amountIn),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pblock(nullptr) { }
+    explicit CScriptCheck(const CBlock& blockIn) :
+        amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(nullptr), pblock(&blockIn) { }
 
     bool operator()();
 
@@ -719,6 +759,7 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pblock, check.pblock);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -727,6 +768,16 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Write the script-execution cache to scriptcache.dat in the data directory. */
+void DumpScriptExecutionCache();
+
+/**
+ * Fill the script-execution cache from scriptcache.dat. Files written by a
+ * different client version are ignored. Must be called before the cache is
+ * used.
+ */
+bool LoadScriptExecutionCache();
+
 bool GetAddressIndex(uint160 addressHash, int type,
     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
     int start = 0, int end = 0);
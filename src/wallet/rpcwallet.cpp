@@ -2526,10 +2526,11 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     size_t kpExternalSize = pwallet->KeypoolCountExternalKeys();
     obj.push_back(Pair("walletname", pwallet->GetName()));
     obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-    obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
-    obj.push_back(Pair("stake",         ValueFromAmount(pwallet->GetStake())));
-    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwallet->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance",    ValueFromAmount(pwallet->GetImmatureBalance())));
+    const WalletBalances balances = pwallet->GetBalances();
+    obj.push_back(Pair("balance",       ValueFromAmount(balances.nTrusted)));
+    obj.push_back(Pair("stake",         ValueFromAmount(balances.nStake)));
+    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(balances.nUntrustedPending)));
+    obj.push_back(Pair("immature_balance",    ValueFromAmount(balances.nImmature)));
     obj.push_back(Pair("txcount",       (int)pwallet->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize", (int64_t)kpExternalSize));
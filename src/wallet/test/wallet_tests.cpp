@@ -364,12 +364,120 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+
+    add_coin(1 * CENT);
+    add_coin(2 * CENT);
+    add_coin(3 * CENT);
+    add_coin(4 * CENT);
+    add_coin(50 * CENT);
+
+    // 5 cents can be made exactly as 1+4 or 2+3; neither overshoots
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(5 * CENT, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // 7 cents exactly as 3+4 is preferred over 1+2+4, which has the same
+    // waste but spends more inputs
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(7 * CENT, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // 9.5 cents can't be made exactly; the 1+2+3+4 overshoot would leave
+    // small change, so without any cost of change the 50 cent coin is used
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(CENT * 95 / 10, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 50 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // a half cent overshoot is still more than a quarter cent cost of change
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(CENT * 95 / 10, 1, 1, 0, vCoins, setCoinsRet, nValueRet, CENT / 4));
+    BOOST_CHECK_EQUAL(nValueRet, 50 * CENT);
+
+    // but if creating change costs a cent, dropping the overshoot is cheaper
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(CENT * 95 / 10, 1, 1, 0, vCoins, setCoinsRet, nValueRet, CENT));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+
+    // many identical coins must not make the search blow up
+    empty_wallet();
+    for (int i = 0; i < 5000; i++)
+        add_coin(COIN);
+    add_coin(CENT);
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(2500 * COIN + CENT, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 2500 * COIN + CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2501U);
+
+    empty_wallet();
+}
+
 static void AddKey(CWallet& wallet, const CKey& key)
 {
     LOCK(wallet.cs_wallet);
     wallet.AddKeyPubKey(key, key.GetPubKey());
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb_effective_value)
+{
+    CWallet wallet;
+    CKey key;
+    key.MakeNewKey(true);
+    AddKey(wallet, key);
+    const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // A dummy-signed compressed P2PKH input is 148 bytes, 1480 satoshi at this rate
+    const CFeeRate feeRate(10000);
+    const CAmount nInputFee = feeRate.GetFee(148);
+
+    std::vector<COutput> vWalletCoins;
+    for (CAmount nValue : {1 * CENT, 2 * CENT, 3 * CENT, 4 * CENT, 5 * CENT + nInputFee}) {
+        CMutableTransaction tx;
+        tx.nLockTime = vWalletCoins.size();
+        tx.vout.emplace_back(nValue, scriptPubKey);
+        std::unique_ptr<CWalletTx> wtx(new CWalletTx(&wallet, MakeTransactionRef(std::move(tx))));
+        vWalletCoins.emplace_back(wtx.get(), 0, 6 * 24, true /* spendable */, true /* solvable */, true /* safe */);
+        wtxn.emplace_back(std::move(wtx));
+    }
+
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    bool fChangeless;
+    LOCK(wallet.cs_wallet);
+
+    // By nominal value 1+4 or 2+3 hit 5 cents exactly
+    BOOST_CHECK(wallet.SelectCoinsMinConf(5 * CENT, 1, 1, 0, vWalletCoins, setCoinsRet, nValueRet, CENT / 100, CFeeRate(), &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // but neither pays for its own inputs, while the largest coin does exactly
+    BOOST_CHECK(wallet.SelectCoinsMinConf(5 * CENT, 1, 1, 0, vWalletCoins, setCoinsRet, nValueRet, CENT / 100, feeRate, &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, 5 * CENT + nInputFee);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // 1+2+3+4 makes 10 cents nominally, but falls short once the four
+    // input fees are paid, so change has to be made
+    BOOST_CHECK(wallet.SelectCoinsMinConf(10 * CENT, 1, 1, 0, vWalletCoins, setCoinsRet, nValueRet, 0, CFeeRate(), &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK(wallet.SelectCoinsMinConf(10 * CENT, 1, 1, 0, vWalletCoins, setCoinsRet, nValueRet, 0, feeRate, &fChangeless));
+    BOOST_CHECK(!fChangeless);
+
+    // 5+3+1 cents lands exactly on the effective target and 5+4 overshoots
+    // by one input fee; both waste the same, and 5+4 needs fewer inputs
+    BOOST_CHECK(wallet.SelectCoinsMinConf(9 * CENT - 2 * nInputFee, 1, 1, 0, vWalletCoins, setCoinsRet, nValueRet, CENT / 100, feeRate, &fChangeless));
+    BOOST_CHECK(fChangeless);
+    BOOST_CHECK_EQUAL(nValueRet, 9 * CENT + nInputFee);
+
+    empty_wallet();
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
 {
     LOCK(cs_main);
@@ -502,6 +610,65 @@ BOOST_FIXTURE_TEST_CASE(importwallet_rescan, TestChain100Setup)
     vpwallets.erase(vpwallets.begin());
 }
 
+// Verify the rescan finds outputs through every kind of wallet entry the
+// pre-match filter is built from (keys, P2SH and witness scripts, and
+// watch-only scripts), whichever reader thread got the block.
+BOOST_FIXTURE_TEST_CASE(rescan_filter, TestChain100Setup)
+{
+    LOCK(cs_main);
+    CBlockIndex* const nullBlock = nullptr;
+    const CAmount nMined = 100 * 50 * COIN;
+
+    // Two more coinbases, paying to a P2SH and a P2WPKH script of
+    // coinbaseKey, which a wallet holding just the key does not own
+    CScript p2pk = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CScript witnessProgram = CScript() << OP_0 << ToByteVector(coinbaseKey.GetPubKey().GetID());
+    uint256 p2shHash = CreateAndProcessBlock({}, GetScriptForDestination(CScriptID(p2pk))).vtx[0]->GetHash();
+    uint256 witnessHash = CreateAndProcessBlock({}, witnessProgram).vtx[0]->GetHash();
+
+    {
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis()));
+        BOOST_CHECK_EQUAL(wallet.GetBalance() + wallet.GetImmatureBalance(), nMined);
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 100U);
+        BOOST_CHECK(!wallet.GetWalletTx(p2shHash));
+        BOOST_CHECK(!wallet.GetWalletTx(witnessHash));
+    }
+
+    {
+        // Outputs to the scripts are found through their script ids
+        CWallet wallet;
+        AddKey(wallet, coinbaseKey);
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddCScript(p2pk));
+        BOOST_CHECK(wallet.AddCScript(witnessProgram));
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis()));
+        BOOST_CHECK(wallet.GetWalletTx(p2shHash));
+        BOOST_CHECK(wallet.GetWalletTx(witnessHash));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 102U);
+    }
+
+    {
+        CWallet wallet;
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddWatchOnly(GetScriptForRawPubKey(coinbaseKey.GetPubKey()), 0 /* nCreateTime */));
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis()));
+        BOOST_CHECK_EQUAL(wallet.GetWatchOnlyBalance() + wallet.GetImmatureWatchOnlyBalance(), nMined);
+        BOOST_CHECK_EQUAL(wallet.GetBalance() + wallet.GetImmatureBalance(), 0);
+    }
+
+    {
+        // A key that never received anything matches nothing.
+        CWallet wallet;
+        CKey key;
+        key.MakeNewKey(true);
+        AddKey(wallet, key);
+        BOOST_CHECK_EQUAL(nullBlock, wallet.ScanForWalletTransactions(chainActive.Genesis()));
+        BOOST_CHECK(wallet.mapWallet.empty());
+    }
+}
+
 // Check that GetImmatureCredit() returns a newly calculated value instead of
 // the cached value after a MarkDirty() call.
 //
@@ -680,4 +847,33 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+BOOST_FIXTURE_TEST_CASE(wallet_balance_cache, ListCoinsTestingSetup)
+{
+    LOCK2(cs_main, wallet->cs_wallet);
+    fCheckWalletBalances = true;
+
+    // One mature coinbase, the rest of the chain still immature.
+    BOOST_CHECK_EQUAL(wallet->GetBalance(), 50 * COIN);
+    BOOST_CHECK(wallet->GetImmatureBalance() > 0);
+    BOOST_CHECK(wallet->CheckBalances());
+    const CAmount nImmature = wallet->GetImmatureBalance();
+
+    // Spending the mature coinbase must come out of the settled total even
+    // though nothing rescans the wallet. The extra block may mature another
+    // coinbase, which only moves funds between categories.
+    AddTx(CRecipient{GetScriptForRawPubKey({}), 1 * COIN, false /* subtract fee */});
+    WalletBalances balances = wallet->GetBalances();
+    BOOST_CHECK(balances.nTrusted + balances.nImmature < 49 * COIN + nImmature);
+    BOOST_CHECK(balances.nTrusted + balances.nImmature > 48 * COIN + nImmature);
+    BOOST_CHECK_EQUAL(balances.nUntrustedPending, 0);
+    BOOST_CHECK(wallet->CheckBalances());
+
+    // A full invalidation rebuilds to the same totals.
+    wallet->MarkDirty();
+    BOOST_CHECK(wallet->GetBalances() == balances);
+    BOOST_CHECK(wallet->CheckBalances());
+
+    fCheckWalletBalances = DEFAULT_CHECK_WALLET_BALANCES;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,7 @@
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "scheduler.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -32,6 +33,9 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -42,6 +46,7 @@ CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fWalletRbf = DEFAULT_WALLET_RBF;
+bool fCheckWalletBalances = DEFAULT_CHECK_WALLET_BALANCES;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
@@ -632,6 +637,11 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
+
+    // The spent transaction's available credit has changed
+    auto it = mapWallet.find(outpoint.hash);
+    if (it != mapWallet.end())
+        it->second.MarkDirty();
 }
 
 void CWallet::RemoveFromSpends(const COutPoint& outpoint, const uint256& wtxid)
@@ -648,6 +658,10 @@ void CWallet::RemoveFromSpends(const COutPoint& outpoint, const uint256& wtxid)
     }
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
+
+    auto mi = mapWallet.find(outpoint.hash);
+    if (mi != mapWallet.end())
+        mi->second.MarkDirty();
 }
 
 void CWallet::AddToSpends(const uint256& wtxid)
@@ -930,6 +944,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        fBalanceRebuild = true;
     }
 }
 
@@ -1345,6 +1360,10 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
     for (const CTransactionRef& ptx : pblock->vtx) {
         SyncTransaction(ptx, nullptr, -1);
     }
+
+    // A lower tip can make mature outputs immature again and undo conflicts,
+    // neither of which marks the affected transactions dirty
+    fBalanceRebuild = true;
 }
 
 
@@ -1690,6 +1709,160 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
  * possible (due to pruning or corruption), returns pointer to the most recent
  * block that could not be scanned.
  */
+namespace {
+
+/**
+ * Append the key and script ids IsMine() could look up for an output script.
+ * Multisig contributes all of its keys, so a match is necessary, not
+ * sufficient, for the output to be ours.
+ */
+void GetScriptMatchIDs(const CScript& scriptPubKey, std::vector<uint160>& vIDs)
+{
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return;
+
+    switch (whichType)
+    {
+    case TX_PUBKEY:
+        vIDs.push_back(CPubKey(vSolutions[0]).GetID());
+        break;
+    case TX_PUBKEYHASH:
+    case TX_SCRIPTHASH:
+        vIDs.push_back(uint160(vSolutions[0]));
+        break;
+    case TX_WITNESS_V0_KEYHASH:
+    case TX_WITNESS_V0_SCRIPTHASH:
+        vIDs.push_back(CScriptID(CScript() << OP_0 << vSolutions[0]));
+        break;
+    case TX_MULTISIG:
+        for (size_t i = 1; i + 1 < vSolutions.size(); i++)
+            vIDs.push_back(CPubKey(vSolutions[i]).GetID());
+        break;
+    default:
+        break;
+    }
+}
+
+/** A block read from disk ahead of the rescan, with its outputs pre-matched */
+struct RescanBlock
+{
+    bool fDone;
+    bool fRead;
+    CBlock block;
+    uint64_t nSize;
+    //! For each transaction, the ids its outputs could be matched by
+    std::vector<std::vector<uint160> > vTxIDs;
+
+    RescanBlock() : fDone(false), fRead(false), nSize(0) {}
+};
+
+/**
+ * Reads and deserializes the blocks of a rescan on background threads, at
+ * most RESCAN_READ_AHEAD blocks ahead of the one being applied. Once the
+ * blocks read ahead add up to RESCAN_READ_AHEAD_SIZE, only the block to be
+ * applied next is read, so large blocks do not pile up in memory. The caller
+ * must hold cs_main for the lifetime of the reader so the block index
+ * entries it reads from stay put.
+ */
+class CRescanReader
+{
+private:
+    const std::vector<CBlockIndex*>& vIndex;
+    const Consensus::Params& consensusParams;
+    std::vector<RescanBlock> vSlots;
+    std::vector<std::thread> vThreads;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nNext;
+    size_t nApplied;
+    uint64_t nSizeAhead;
+    bool fStop;
+
+    void ThreadRead()
+    {
+        while (true) {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]{
+                    return fStop || nNext >= vIndex.size() || nNext == nApplied ||
+                           (nNext < nApplied + vSlots.size() && nSizeAhead < RESCAN_READ_AHEAD_SIZE);
+                });
+                if (fStop || nNext >= vIndex.size())
+                    return;
+                i = nNext++;
+            }
+
+            RescanBlock& slot = vSlots[i % vSlots.size()];
+            slot.fRead = ReadBlockFromDisk(slot.block, vIndex[i], consensusParams);
+            slot.nSize = slot.fRead ? ::GetSerializeSize(slot.block, SER_DISK, CLIENT_VERSION) : 0;
+            if (slot.fRead) {
+                slot.vTxIDs.resize(slot.block.vtx.size());
+                for (size_t n = 0; n < slot.block.vtx.size(); n++) {
+                    slot.vTxIDs[n].clear();
+                    for (const CTxOut& txout : slot.block.vtx[n]->vout)
+                        GetScriptMatchIDs(txout.scriptPubKey, slot.vTxIDs[n]);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.fDone = true;
+                nSizeAhead += slot.nSize;
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    CRescanReader(const std::vector<CBlockIndex*>& vIndexIn, const Consensus::Params& consensusParamsIn)
+        : vIndex(vIndexIn), consensusParams(consensusParamsIn), vSlots(RESCAN_READ_AHEAD), nNext(0), nApplied(0), nSizeAhead(0), fStop(false)
+    {
+        int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        for (int n = 0; n < nThreads; n++)
+            vThreads.emplace_back(&CRescanReader::ThreadRead, this);
+    }
+
+    ~CRescanReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& thread : vThreads)
+            thread.join();
+    }
+
+    //! Wait for block i (which must be the next one to apply) to be read
+    RescanBlock& Get(size_t i)
+    {
+        RescanBlock& slot = vSlots[i % vSlots.size()];
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&slot]{ return slot.fDone; });
+        return slot;
+    }
+
+    //! Hand the slot of block i back to the readers
+    void Release(size_t i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            RescanBlock& slot = vSlots[i % vSlots.size()];
+            slot.fDone = false;
+            slot.block.SetNull();
+            nSizeAhead -= slot.nSize;
+            nApplied = i + 1;
+        }
+        cond.notify_all();
+    }
+};
+
+} // namespace
+
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int64_t nNow = GetTime();
@@ -1705,8 +1878,59 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
         double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex && !fAbortRescan)
+
+        std::vector<CBlockIndex*> vIndex;
+        for (CBlockIndex* pindexScan = pindex; pindexScan; pindexScan = chainActive.Next(pindexScan))
+            vIndex.push_back(pindexScan);
+
+        // Everything IsMine() could match an output by. Rebuilt whenever the
+        // keystore grows, which happens when a keypool key is seen in use.
+        std::set<uint160> setMatchIDs;
+        std::set<CScript> setWatchScripts;
+        std::tuple<int64_t, size_t, size_t> filterVersion(-1, 0, 0);
+        auto updateFilter = [&]() {
+            LOCK(cs_KeyStore);
+            std::tuple<int64_t, size_t, size_t> version(m_max_keypool_index, mapScripts.size(), setWatchOnly.size());
+            if (version == filterVersion)
+                return;
+            filterVersion = version;
+            std::set<CKeyID> setKeys;
+            GetKeys(setKeys);
+            setMatchIDs.clear();
+            setMatchIDs.insert(setKeys.begin(), setKeys.end());
+            for (const auto& entry : mapScripts)
+                setMatchIDs.insert(entry.first);
+            setWatchScripts = setWatchOnly;
+        };
+
+        // A transaction can only involve us if one of its outputs matches
+        // the filter, or it spends from or conflicts with a wallet
+        // transaction; for any other AddToWalletIfInvolvingMe is a no-op.
+        auto mayInvolveMe = [&](const CTransaction& tx, const std::vector<uint160>& vIDs) {
+            if (mapWallet.count(tx.GetHash()))
+                return true;
+            for (const uint160& id : vIDs) {
+                if (setMatchIDs.count(id))
+                    return true;
+            }
+            if (!setWatchScripts.empty()) {
+                for (const CTxOut& txout : tx.vout) {
+                    if (setWatchScripts.count(txout.scriptPubKey))
+                        return true;
+                }
+            }
+            for (const CTxIn& txin : tx.vin) {
+                if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+                    return true;
+            }
+            return false;
+        };
+
+        updateFilter();
+        CRescanReader reader(vIndex, chainParams.GetConsensus());
+        for (size_t i = 0; i < vIndex.size() && !fAbortRescan; i++)
         {
+            pindex = vIndex[i];
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
             if (GetTime() >= nNow + 60) {
@@ -1714,14 +1938,18 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
                 LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+            RescanBlock& slot = reader.Get(i);
+            if (slot.fRead) {
+                for (size_t posInBlock = 0; posInBlock < slot.block.vtx.size(); ++posInBlock) {
+                    if (mayInvolveMe(*slot.block.vtx[posInBlock], slot.vTxIDs[posInBlock]) &&
+                        AddToWalletIfInvolvingMe(slot.block.vtx[posInBlock], pindex, posInBlock, fUpdate)) {
+                        updateFilter();
+                    }
                 }
             } else {
                 ret = pindex;
             }
+            reader.Release(i);
             pindex = chainActive.Next(pindex);
         }
         if (pindex && fAbortRescan) {
@@ -1801,6 +2029,22 @@ std::set<uint256> CWalletTx::GetConflicts() const
     return result;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter& filter) const
 {
     if (tx->vin.empty())
@@ -2066,94 +2310,179 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+WalletBalances& WalletBalances::operator+=(const WalletBalances& other)
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+    nTrusted += other.nTrusted;
+    nUntrustedPending += other.nUntrustedPending;
+    nImmature += other.nImmature;
+    nWatchOnlyTrusted += other.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending += other.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature += other.nWatchOnlyImmature;
+    nStake += other.nStake;
+    return *this;
+}
+
+WalletBalances& WalletBalances::operator-=(const WalletBalances& other)
+{
+    nTrusted -= other.nTrusted;
+    nUntrustedPending -= other.nUntrustedPending;
+    nImmature -= other.nImmature;
+    nWatchOnlyTrusted -= other.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending -= other.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature -= other.nWatchOnlyImmature;
+    nStake -= other.nStake;
+    return *this;
+}
+
+bool WalletBalances::operator==(const WalletBalances& other) const
+{
+    return nTrusted == other.nTrusted &&
+           nUntrustedPending == other.nUntrustedPending &&
+           nImmature == other.nImmature &&
+           nWatchOnlyTrusted == other.nWatchOnlyTrusted &&
+           nWatchOnlyUntrustedPending == other.nWatchOnlyUntrustedPending &&
+           nWatchOnlyImmature == other.nWatchOnlyImmature &&
+           nStake == other.nStake;
+}
+
+WalletBalances CWallet::GetTxBalances(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    WalletBalances balances;
+    const int nDepth = wtx.GetDepthInMainChain();
+    if (wtx.IsTrusted()) {
+        balances.nTrusted = wtx.GetAvailableCredit();
+        balances.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balances.nUntrustedPending = wtx.GetAvailableCredit();
+        balances.nWatchOnlyUntrustedPending = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+    if (wtx.IsCoinStake() && wtx.GetBlocksToMaturity() > 0 && nDepth > 0)
+        balances.nStake = GetCredit(*wtx.tx, ISMINE_SPENDABLE);
+    return balances;
+}
+
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    setBalanceDirty.insert(hash);
+}
+
+WalletBalances CWallet::GetBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    if (fBalanceRebuild) {
+        balanceSettled = WalletBalances();
+        mapBalanceSettled.clear();
+        setBalanceVolatile.clear();
+        setBalanceDirty.clear();
+        for (const auto& entry : mapWallet)
+            setBalanceVolatile.insert(setBalanceVolatile.end(), entry.first);
+        fBalanceRebuild = false;
+    }
+
+    // Take dirty transactions out of the settled totals and reclassify them
+    // together with the volatile ones below
+    for (const uint256& hash : setBalanceDirty) {
+        auto it = mapBalanceSettled.find(hash);
+        if (it != mapBalanceSettled.end()) {
+            balanceSettled -= it->second;
+            mapBalanceSettled.erase(it);
+        }
+        setBalanceVolatile.insert(hash);
+    }
+    setBalanceDirty.clear();
+
+    WalletBalances balances;
+    for (auto it = setBalanceVolatile.begin(); it != setBalanceVolatile.end(); ) {
+        auto mi = mapWallet.find(*it);
+        if (mi == mapWallet.end()) {
+            it = setBalanceVolatile.erase(it);
+            continue;
+        }
+        const CWalletTx& wtx = mi->second;
+        const WalletBalances txBalances = GetTxBalances(wtx);
+        const int nDepth = wtx.GetDepthInMainChain();
+        if (nDepth < 0 || wtx.isAbandoned() || (nDepth > 0 && wtx.GetBlocksToMaturity() == 0)) {
+            balanceSettled += txBalances;
+            mapBalanceSettled.emplace(*it, txBalances);
+            it = setBalanceVolatile.erase(it);
+        } else {
+            balances += txBalances;
+            ++it;
         }
     }
+    balances += balanceSettled;
+
+    if (fCheckWalletBalances)
+        assert(CheckBalances());
+
+    return balances;
+}
+
+bool CWallet::CheckBalances() const
+{
+    LOCK2(cs_main, cs_wallet);
+
+    // Only meaningful once pending updates have been applied by GetBalances
+    if (fBalanceRebuild || !setBalanceDirty.empty())
+        return true;
+
+    WalletBalances expected;
+    for (const auto& entry : mapWallet)
+        expected += GetTxBalances(entry.second);
+
+    WalletBalances cached = balanceSettled;
+    for (const uint256& hash : setBalanceVolatile) {
+        auto mi = mapWallet.find(hash);
+        if (mi != mapWallet.end())
+            cached += GetTxBalances(mi->second);
+    }
 
-    return nTotal;
+    if (cached != expected) {
+        LogPrintf("%s: wallet balance cache mismatch: trusted %s/%s, pending %s/%s, immature %s/%s, stake %s/%s\n", __func__,
+            FormatMoney(cached.nTrusted), FormatMoney(expected.nTrusted),
+            FormatMoney(cached.nUntrustedPending), FormatMoney(expected.nUntrustedPending),
+            FormatMoney(cached.nImmature), FormatMoney(expected.nImmature),
+            FormatMoney(cached.nStake), FormatMoney(expected.nStake));
+        return false;
+    }
+    return true;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2434,24 +2763,121 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
-CAmount CWallet::GetStake() const
+//! Maximum number of search steps taken by SelectCoinsBnB before giving up
+static const int BNB_MAX_TRIES = 100000;
+
+/**
+ * Deterministic branch-and-bound search for a changeless input set.
+ *
+ * vValue must be sorted by descending effective value, with effective values
+ * summing to nTotalLower. Looks for a subset whose effective value lies in
+ * [nTargetValue, nTargetValue + nCostOfChange], i.e. that pays the target and
+ * the fees for its own inputs with an excess small enough that no change
+ * output would be created. Among those, the one with the least waste is
+ * chosen: the excess plus the fees for its inputs, with ties going to the set
+ * with fewer inputs.
+ */
+static bool SelectCoinsBnB(const std::vector<const CInputCoin*>& vValue, const CAmount& nTotalLower, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                           std::vector<char>& vfBest, CAmount& nBest)
 {
+    std::vector<char> vfSelection;
+    vfSelection.reserve(vValue.size());
     CAmount nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (auto it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    CAmount nFees = 0;
+    CAmount nAvailable = nTotalLower;
+    size_t nInputs = 0;
+
+    CAmount nBestWaste = MAX_MONEY;
+    size_t nBestInputs = 0;
+    bool fFound = false;
+
+    for (int nTries = 0; nTries < BNB_MAX_TRIES; nTries++)
     {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_SPENDABLE);
+        bool fBacktrack = false;
+        if (nTotal + nAvailable < nTargetValue || nTotal > nTargetValue + nCostOfChange) {
+            // Cannot reach the target any more, or already past the window
+            fBacktrack = true;
+        } else if (nTotal >= nTargetValue) {
+            const CAmount nWaste = nTotal - nTargetValue + nFees;
+            if (!fFound || nWaste < nBestWaste || (nWaste == nBestWaste && nInputs < nBestInputs)) {
+                fFound = true;
+                nBestWaste = nWaste;
+                nBestInputs = nInputs;
+                vfBest = vfSelection;
+                nBest = nTotal;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Walk back to the last included coin and try omitting it instead
+            while (!vfSelection.empty() && !vfSelection.back()) {
+                vfSelection.pop_back();
+                nAvailable += vValue[vfSelection.size()]->nEffectiveValue;
+            }
+            if (vfSelection.empty())
+                break; // search space exhausted
+            vfSelection.back() = false;
+            nTotal -= vValue[vfSelection.size() - 1]->nEffectiveValue;
+            nFees -= vValue[vfSelection.size() - 1]->nInputFee;
+            nInputs--;
+        } else {
+            const CInputCoin& coin = *vValue[vfSelection.size()];
+            nAvailable -= coin.nEffectiveValue;
+            // Including a coin after omitting an equivalent one would only
+            // revisit a combination that has already been explored
+            if (!vfSelection.empty() && !vfSelection.back() &&
+                coin.nEffectiveValue == vValue[vfSelection.size() - 1]->nEffectiveValue &&
+                coin.nInputFee == vValue[vfSelection.size() - 1]->nInputFee) {
+                vfSelection.push_back(false);
+            } else {
+                vfSelection.push_back(true);
+                nTotal += coin.nEffectiveValue;
+                nFees += coin.nInputFee;
+                nInputs++;
+            }
+        }
     }
-    return nTotal;
+
+    if (fFound)
+        vfBest.resize(vValue.size(), false);
+    return fFound;
+}
+
+/**
+ * Virtual size a dummy-signed input spending txout adds to a transaction, or
+ * -1 if the wallet can't produce a signature for it.
+ */
+static int CalculateSignedInputSize(const CWallet* pwallet, const CTxOut& txout)
+{
+    SignatureData sigdata;
+    if (!ProduceSignature(DummySignatureCreator(pwallet), txout.scriptPubKey, sigdata))
+        return -1;
+    CMutableTransaction txNew;
+    txNew.vin.resize(1);
+    UpdateTransaction(txNew, 0, sigdata);
+
+    const CTxIn& txin = txNew.vin[0];
+    int64_t nWeight = ::GetSerializeSize(txin, SER_NETWORK, PROTOCOL_VERSION) * WITNESS_SCALE_FACTOR;
+    if (!txin.scriptWitness.IsNull()) {
+        // Charge the segwit marker and flag to every input that needs them
+        nWeight += ::GetSerializeSize(txin.scriptWitness.stack, SER_NETWORK, PROTOCOL_VERSION) + 2;
+    }
+    return (nWeight + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR;
+}
+
+CAmount CWallet::GetStake() const
+{
+    return GetBalances().nStake;
 }
 
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CAmount& nCostOfChange, const CFeeRate& effectiveFeeRate, bool* pfChangeless) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
+    if (pfChangeless)
+        *pfChangeless = false;
 
     // List of values less than target
     boost::optional<CInputCoin> coinLowestLarger;
@@ -2470,17 +2896,30 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs))
             continue;
 
-        if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
+        // Confirmed transactions are never in the mempool, so only look up
+        // the ancestor count of unconfirmed ones
+        if (output.nDepth == 0 && !mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
             continue;
 
         int i = output.i;
 
         CInputCoin coin = CInputCoin(pcoin, i);
+        if (effectiveFeeRate > CFeeRate()) {
+            const int nInputBytes = CalculateSignedInputSize(this, coin.txout);
+            if (nInputBytes < 0) {
+                coin.nEffectiveValue = 0;
+            } else {
+                coin.nInputFee = effectiveFeeRate.GetFee(nInputBytes);
+                coin.nEffectiveValue = std::max<CAmount>(coin.txout.nValue - coin.nInputFee, 0);
+            }
+        }
 
-        if (coin.txout.nValue == nTargetValue)
+        if (coin.nEffectiveValue == nTargetValue)
         {
             setCoinsRet.insert(coin);
             nValueRet += coin.txout.nValue;
+            if (pfChangeless)
+                *pfChangeless = true;
             return true;
         }
         else if (coin.txout.nValue < nTargetValue + MIN_CHANGE)
@@ -2513,12 +2952,41 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
     std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
     std::reverse(vValue.begin(), vValue.end());
     std::vector<char> vfBest;
     CAmount nBest;
 
+    // Prefer a subset that needs no change output at all, judging coins by
+    // what they are worth once their own input fee is paid
+    std::vector<const CInputCoin*> vEffective;
+    vEffective.reserve(vValue.size());
+    CAmount nEffectiveTotal = 0;
+    for (const CInputCoin& coin : vValue) {
+        if (coin.nEffectiveValue > 0) {
+            vEffective.push_back(&coin);
+            nEffectiveTotal += coin.nEffectiveValue;
+        }
+    }
+    std::stable_sort(vEffective.begin(), vEffective.end(), [](const CInputCoin* a, const CInputCoin* b) {
+        return a->nEffectiveValue > b->nEffectiveValue;
+    });
+    if (SelectCoinsBnB(vEffective, nEffectiveTotal, nTargetValue, nCostOfChange, vfBest, nBest))
+    {
+        for (unsigned int i = 0; i < vEffective.size(); i++)
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(*vEffective[i]);
+                nValueRet += vEffective[i]->txout.nValue;
+            }
+        if (pfChangeless)
+            *pfChangeless = true;
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() changeless subset of %u coins, total %s, effective %s\n", setCoinsRet.size(), FormatMoney(nValueRet), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
@@ -2553,9 +3021,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     return true;
 }
 
-bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
+bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl,
+                          const CAmount& nCostOfChange, const CFeeRate& effectiveFeeRate, bool* pfChangeless) const
 {
     std::vector<COutput> vCoins(vAvailableCoins);
+    if (pfChangeless)
+        *pfChangeless = false;
 
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs)
@@ -2605,13 +3076,13 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet));
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless) ||
+        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, nCostOfChange, effectiveFeeRate, pfChangeless));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -2896,6 +3367,16 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
             size_t change_prototype_size = GetSerializeSize(change_prototype_txout, SER_DISK, 0);
 
             CFeeRate discard_rate = GetDiscardRate(::feeEstimator);
+            // Any excess below this would be dropped into the fee rather than
+            // paid out as change, so inputs that overshoot by less need no change
+            const CAmount nCostOfChange = GetDustThreshold(change_prototype_txout, discard_rate);
+            // The first selection looks for a changeless set by the value each
+            // coin has left after paying for its own input at this feerate.
+            // Inputs selected by hand, or fees taken from the recipients, are
+            // not accounted for that way, so those fall back to nominal values.
+            const CFeeRate effectiveFeeRate(GetMinimumFee(1000, coin_control, ::mempool, ::feeEstimator, nullptr));
+            bool fUseEffectiveValue = nSubtractFeeFromAmount == 0 && !coin_control.HasSelected();
+            bool fChangeless = false;
             nFeeRet = 0;
             bool pick_new_inputs = true;
             CAmount nValueIn = 0;
@@ -2945,9 +3426,16 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
                 // Choose coins to use
                 if (pick_new_inputs) {
+                    if (fUseEffectiveValue) {
+                        // Target the fee for everything but the inputs; the
+                        // selected coins pay for themselves
+                        nFeeRet = effectiveFeeRate.GetFee(GetVirtualTransactionSize(txNew));
+                        nValueToSelect = nValue + nFeeRet;
+                    }
                     nValueIn = 0;
                     setCoins.clear();
-                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control))
+                    if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, &coin_control, nCostOfChange,
+                                     fUseEffectiveValue ? effectiveFeeRate : CFeeRate(), &fChangeless))
                     {
                         strFailReason = _("Insufficient funds");
                         return false;
@@ -2956,7 +3444,13 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
                 const CAmount nChange = nValueIn - nValueToSelect;
 
-                if (nChange > 0)
+                if (fChangeless)
+                {
+                    // The excess was chosen to be cheaper as fee than as change
+                    nChangePosInOut = -1;
+                    nFeeRet += nChange;
+                }
+                else if (nChange > 0)
                 {
                     // Fill a vout to ourself
                     CTxOut newTxOut(nChange, scriptChange);
@@ -3044,6 +3538,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
                         CAmount minimum_value_for_change = GetDustThreshold(change_prototype_txout, discard_rate);
                         if (nFeeRet >= fee_needed_with_change + minimum_value_for_change) {
                             pick_new_inputs = false;
+                            fChangeless = false;
                             nFeeRet = fee_needed_with_change;
                             continue;
                         }
@@ -3087,6 +3582,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
                 // Include more fee and try again.
                 nFeeRet = nFeeNeeded;
+                fUseEffectiveValue = false;
                 continue;
             }
         }
@@ -3490,8 +3986,10 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     AssertLockHeld(cs_wallet); // mapWallet
     vchDefaultKey = CPubKey();
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
-    for (uint256 hash : vHashOut)
+    for (uint256 hash : vHashOut) {
         mapWallet.erase(hash);
+        MarkBalanceDirty(hash);
+    }
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -4277,6 +4775,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
 
+        strUsage += HelpMessageOpt("-checkwalletbalances", strprintf("Verify the wallet's running balance totals against a full scan on every balance query (default: %u)", DEFAULT_CHECK_WALLET_BALANCES));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf("Flush wallet database activity from memory to disk log every <n> megabytes (default: %u)", DEFAULT_WALLET_DBLOGSIZE));
         strUsage += HelpMessageOpt("-flushwallet", strprintf("Run a thread to flush wallet periodically (default: %u)", DEFAULT_FLUSHWALLET));
         strUsage += HelpMessageOpt("-privdb", strprintf("Sets the DB_PRIVATE flag in the wallet db environment (default: %u)", DEFAULT_WALLET_PRIVDB));
@@ -4627,6 +5126,7 @@ bool CWallet::ParameterInteraction()
     nTxConfirmTarget = gArgs.GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     bSpendZeroConfChange = gArgs.GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fWalletRbf = gArgs.GetBoolArg("-walletrbf", DEFAULT_WALLET_RBF);
+    fCheckWalletBalances = gArgs.GetBoolArg("-checkwalletbalances", DEFAULT_CHECK_WALLET_BALANCES);
 
     return true;
 }
@@ -40,8 +40,15 @@ extern CFeeRate payTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fWalletRbf;
+extern bool fCheckWalletBalances;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! Maximum number of threads reading blocks ahead of a wallet rescan
+static const int MAX_RESCAN_THREADS = 4;
+//! Number of blocks a wallet rescan may read ahead of the one it applies
+static const int RESCAN_READ_AHEAD = 16;
+//! Serialized size of the blocks a wallet rescan may keep read ahead of the one it applies
+static const uint64_t RESCAN_READ_AHEAD_SIZE = 32 * 1000 * 1000;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
 //! -fallbackfee default
@@ -60,6 +67,8 @@ static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -walletrejectlongchains
 static const bool DEFAULT_WALLET_REJECT_LONG_CHAINS = false;
+//! Default for -checkwalletbalances
+static const bool DEFAULT_CHECK_WALLET_BALANCES = false;
 //! -txconfirmtarget default
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
@@ -427,19 +436,8 @@ public:
         mapValue.erase("timesmart");
     }
 
-    //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! make sure balances are recalculated, also in the wallet's running totals
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -491,10 +489,16 @@ public:
 
         outpoint = COutPoint(walletTx->GetHash(), i);
         txout = walletTx->tx->vout[i];
+        nEffectiveValue = txout.nValue;
+        nInputFee = 0;
     }
 
     COutPoint outpoint;
     CTxOut txout;
+    //! Value left after paying for this input at the selection's feerate, or 0 if its size is unknown
+    CAmount nEffectiveValue;
+    //! Fee for spending this input at the selection's feerate
+    CAmount nInputFee;
 
     bool operator<(const CInputCoin& rhs) const {
         return outpoint < rhs.outpoint;
@@ -650,6 +654,26 @@ private:
 };
 
 
+/** Wallet balance totals, one per balance category */
+struct WalletBalances
+{
+    CAmount nTrusted;
+    CAmount nUntrustedPending;
+    CAmount nImmature;
+    CAmount nWatchOnlyTrusted;
+    CAmount nWatchOnlyUntrustedPending;
+    CAmount nWatchOnlyImmature;
+    CAmount nStake;
+
+    WalletBalances() : nTrusted(0), nUntrustedPending(0), nImmature(0), nWatchOnlyTrusted(0),
+                       nWatchOnlyUntrustedPending(0), nWatchOnlyImmature(0), nStake(0) {}
+
+    WalletBalances& operator+=(const WalletBalances& other);
+    WalletBalances& operator-=(const WalletBalances& other);
+    bool operator==(const WalletBalances& other) const;
+    bool operator!=(const WalletBalances& other) const { return !(*this == other); }
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -667,7 +691,8 @@ private:
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr,
+                     const CAmount& nCostOfChange = 0, const CFeeRate& effectiveFeeRate = CFeeRate(), bool* pfChangeless = nullptr) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -731,6 +756,23 @@ private:
 
     std::unique_ptr<CWalletDBWrapper> dbw;
 
+    /**
+     * Running balance totals. Transactions whose contribution can only
+     * change through an event that marks them dirty (confirmed and mature,
+     * conflicted or abandoned) are summed into balanceSettled. The others
+     * depend on the tip and the mempool and are recomputed on every query;
+     * there are few of them (unconfirmed, or immature coinbase/coinstake).
+     * Protected by cs_wallet.
+     */
+    mutable WalletBalances balanceSettled;
+    mutable std::map<uint256, WalletBalances> mapBalanceSettled;
+    mutable std::set<uint256> setBalanceVolatile;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable bool fBalanceRebuild;
+
+    //! Contribution of a single transaction to each balance category
+    WalletBalances GetTxBalances(const CWalletTx& wtx) const;
+
 public:
     /*
      * Main wallet lock.
@@ -801,6 +843,7 @@ public:
         nRelockTime = 0;
         fAbortRescan = false;
         fScanningWallet = false;
+        fBalanceRebuild = true;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -844,11 +887,18 @@ public:
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
-     * small change; This method is stochastic for some inputs and upon
-     * completion the coin set and corresponding actual target value is
-     * assembled
+     * small change; A changeless set overshooting the target by at most
+     * nCostOfChange is searched for first by branch and bound, otherwise
+     * this method is stochastic for some inputs and upon completion the coin
+     * set and corresponding actual target value is assembled.
+     * With a non-zero effectiveFeeRate the branch and bound search counts each
+     * coin net of the fee for spending it at that rate, so nTargetValue must
+     * not include the fee for the inputs. *pfChangeless is set when the
+     * returned set needs no change output, i.e. all of nValueRet beyond
+     * nTargetValue is meant to go to fees.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet,
+                            const CAmount& nCostOfChange = 0, const CFeeRate& effectiveFeeRate = CFeeRate(), bool* pfChangeless = nullptr) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -937,6 +987,12 @@ public:
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    /** Queue a transaction's balance contribution for recomputation */
+    void MarkBalanceDirty(const uint256& hash) const;
+    /** All balance categories at once, brought up to date from the running totals */
+    WalletBalances GetBalances() const;
+    /** Compare the running totals against a full scan of mapWallet */
+    bool CheckBalances() const;
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;